@@ -0,0 +1,126 @@
+// Arena.c ... implementation of allocation arenas
+// An arena hands out objects from the current block by bumping a pointer;
+// when it runs out it moves to the next block, taking a new one from myHeap
+// if there is none. An object bigger than a block gets a block of its own.
+// A reset just moves back to the first block.
+// Blocks are pointer-aligned and sizes are rounded up to pointer size, so
+// every object is aligned for anything up to a pointer.
+
+#include <stdlib.h>
+#include <assert.h>
+#include "Arena.h"
+#include "myHeap.h"
+
+typedef struct block {
+	struct block *next;  // next block in this arena
+	int size;            // bytes of objects the block holds
+} Block;
+
+struct arena {
+	int    blockSize;  // bytes in each ordinary block
+	Block *first;      // every block, in the order they are used
+	Block *curr;       // block objects are coming from
+	char  *next;       // next free byte in curr
+	char  *end;        // end of curr
+};
+
+#define ROUND(n) (((n) + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *))
+
+// create an arena taking blocks of (at least) blockSize bytes from the heap
+Arena newArena(int blockSize)
+{
+	assert(blockSize > 0);
+	Arena a = myMemalign(sizeof(void *), sizeof(struct arena));
+	if (a == NULL) return NULL;
+	a->blockSize = ROUND(blockSize);
+	a->first = a->curr = NULL;
+	a->next = a->end = NULL;
+	return a;
+}
+
+// free every block of an Arena, and the Arena itself
+void dropArena(Arena a)
+{
+	if (a == NULL) return;
+	while (a->first != NULL) {
+		Block *next = a->first->next;
+		myFree(a->first);
+		a->first = next;
+	}
+	myFree(a);
+}
+
+// start handing out objects from block b
+static void useBlock(Arena a, Block *b)
+{
+	a->curr = b;
+	a->next = (char *)(b + 1);
+	a->end = a->next + b->size;
+}
+
+// move on to a block with room for size bytes, reusing the next one if it is big enough
+static int nextBlock(Arena a, int size)
+{
+	Block *b = (a->curr == NULL) ? a->first : a->curr->next;
+	if (b == NULL || b->size < size) {
+		Block *new = myMemalign(sizeof(void *), sizeof(Block) + a->blockSize);
+		if (new == NULL) return 0;
+		new->size = a->blockSize;
+		new->next = b;                       // a smaller block after curr stays for later
+		if (a->curr == NULL)
+			a->first = new;
+		else
+			a->curr->next = new;
+		b = new;
+	}
+	useBlock(a, b);
+	return 1;
+}
+
+// give an object too big for a block a block of its own, put at the front of the
+// list so the rest of the current block is not wasted
+static void *bigObject(Arena a, int size)
+{
+	Block *b = myMemalign(sizeof(void *), sizeof(Block) + size);
+	if (b == NULL) return NULL;
+	b->size = size;
+	b->next = a->first;
+	a->first = b;
+	if (a->curr == NULL) {                   // nothing in use yet, so it becomes current, full
+		useBlock(a, b);
+		a->next = a->end;
+	}
+	return b + 1;
+}
+
+// allocate an object from an Arena, NULL if the heap is full
+void *arenaAlloc(Arena a, int size)
+{
+	assert(size > 0);
+	size = ROUND(size);
+	if (a->end - a->next < size) {
+		Block *b = (a->curr == NULL) ? a->first : a->curr->next;
+		if (size > a->blockSize && (b == NULL || b->size < size)) return bigObject(a, size);
+		if (!nextBlock(a, size)) return NULL;
+	}
+	void *obj = a->next;
+	a->next += size;
+	return obj;
+}
+
+// forget every object in an Arena at once, keeping its blocks for reuse
+void arenaReset(Arena a)
+{
+	if (a->first == NULL) return;
+	useBlock(a, a->first);
+}
+
+// check whether an object lies in one of an Arena's blocks
+int arenaOwns(Arena a, void *obj)
+{
+	for (Block *b = a->first; b != NULL; b = b->next) {
+		char *start = (char *)(b + 1);
+		if ((char *)obj >= start && (char *)obj < start + b->size) return 1;
+	}
+	return 0;
+}
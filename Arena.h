@@ -0,0 +1,22 @@
+// Arena.h ... interface to allocation arenas
+// Objects are bump-allocated from blocks carved out of myHeap
+// and are only ever freed all together
+
+#ifndef ARENA_H
+#define ARENA_H
+
+typedef struct arena *Arena;
+
+// create an arena taking blocks of (at least) blockSize bytes from the heap
+Arena newArena(int blockSize);
+// free every block of an Arena, and the Arena itself
+void dropArena(Arena);
+
+// allocate an object from an Arena, NULL if the heap is full
+void *arenaAlloc(Arena, int size);
+// forget every object in an Arena at once, keeping its blocks for reuse
+void arenaReset(Arena);
+// check whether an object lies in one of an Arena's blocks
+int arenaOwns(Arena, void *);
+
+#endif
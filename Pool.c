@@ -0,0 +1,98 @@
+// Pool.c ... implementation of fixed-size object pools
+// Each slab is one pointer-aligned chunk holding many objects back to back;
+// free objects are threaded onto a list through their first bytes.
+// Slabs stay with the pool until dropPool.
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "Pool.h"
+#include "myHeap.h"
+
+#define PER_SLAB 64  // objects in each slab
+
+typedef struct slab {
+	struct slab *next;  // next slab in this pool
+} Slab;
+
+typedef struct freeObj {
+	struct freeObj *next;  // next free object in this pool
+} FreeObj;
+
+struct pool {
+	int      size;   // bytes per object
+	Slab    *slabs;  // every slab allocated for this pool
+	FreeObj *free;   // free objects, most recently freed first
+};
+
+// create a pool handing out objects of the given size
+Pool newPool(int size)
+{
+	assert(size > 0);
+	Pool p = myMemalign(sizeof(void *), sizeof(struct pool));  // myMalloc only promises 4 bytes
+	if (p == NULL) return NULL;
+	// slabs and their headers are pointer-aligned, and a size from sizeof is a
+	// multiple of the object's alignment, so objects needing no more than a
+	// pointer's alignment are packed as tight as that allows; an object may be
+	// less aligned than a pointer, so links are copied in and out with memcpy
+	if (size < sizeof(FreeObj)) size = sizeof(FreeObj);
+	p->size = size;
+	p->slabs = NULL;
+	p->free = NULL;
+	return p;
+}
+
+// free every slab of a Pool, and the Pool itself
+// slabs go back in batches, so runs of neighbouring slabs coalesce in one pass
+void dropPool(Pool p)
+{
+	if (p == NULL) return;
+	void *batch[PER_SLAB];
+	int n = 0;
+	while (p->slabs != NULL) {
+		Slab *next = p->slabs->next;
+		batch[n++] = p->slabs;
+		if (n == PER_SLAB) {
+			myFreeBatch(batch, n);
+			n = 0;
+		}
+		p->slabs = next;
+	}
+	myFreeBatch(batch, n);
+	myFree(p);
+}
+
+// carve a new slab into free objects
+static int addSlab(Pool p)
+{
+	Slab *s = myMemalign(sizeof(void *), sizeof(Slab) + PER_SLAB*p->size);
+	if (s == NULL) return 0;
+	s->next = p->slabs;
+	p->slabs = s;
+	// thread objects so the first one handed out is lowest in memory
+	char *obj = (char *)(s + 1);
+	for (int i = PER_SLAB-1; i >= 0; i--) {
+		FreeObj *f = (FreeObj *)(obj + i*p->size);
+		memcpy(f, &p->free, sizeof(FreeObj *));
+		p->free = f;
+	}
+	return 1;
+}
+
+// allocate an object from a Pool, NULL if the heap is full
+void *poolAlloc(Pool p)
+{
+	if (p->free == NULL && !addSlab(p)) return NULL;
+	FreeObj *f = p->free;
+	memcpy(&p->free, f, sizeof(FreeObj *));
+	return f;
+}
+
+// return an object to the Pool it came from
+void poolFree(Pool p, void *obj)
+{
+	if (obj == NULL) return;
+	FreeObj *f = obj;
+	memcpy(f, &p->free, sizeof(FreeObj *));
+	p->free = f;
+}
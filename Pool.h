@@ -0,0 +1,19 @@
+// Pool.h ... interface to fixed-size object pools
+// Objects come from slabs carved out of myHeap
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct pool *Pool;
+
+// create a pool handing out objects of the given size
+Pool newPool(int size);
+// free every slab of a Pool, and the Pool itself
+void dropPool(Pool);
+
+// allocate an object from a Pool, NULL if the heap is full
+void *poolAlloc(Pool);
+// return an object to the Pool it came from
+void poolFree(Pool, void *);
+
+#endif
@@ -0,0 +1,39 @@
+// Trace.h ... format of myHeap allocation traces
+// A trace is a TRACE_INIT record, a TRACE_CONFIG record per other setting of the heap, then one record per call
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_INIT    0   // size = heap size, old = alignment, offset = mapAbove or TRACE_NONE
+#define TRACE_MALLOC  1   // size = bytes asked for
+#define TRACE_FREE    2
+#define TRACE_REALLOC 3   // size = new size, old = offset of the block resized
+#define TRACE_CALLOC  4   // size = total bytes asked for
+#define TRACE_MEMALIGN 5  // size = bytes asked for, old = alignment
+#define TRACE_CONFIG  6   // size = value of the setting, old = which one of the TRACE_SET codes
+
+// settings carried by TRACE_CONFIG records, named after their HeapConfig fields
+#define TRACE_SET_MAX_SIZE   0
+#define TRACE_SET_GROW_BY    1
+#define TRACE_SET_POLICY     2
+#define TRACE_SET_HIGH_ABOVE 3
+#define TRACE_SET_COMPACT    4
+#define TRACE_SET_MAPPED     5   // non-zero if the heap was mapped from the system
+#define TRACE_SET_CONCURRENT 6
+
+// offset of a block that does not exist, e.g. a failed malloc
+#define TRACE_NONE    0xFFFFFFFFFFFFFFFFULL
+
+// set in the offset of a block with a mapping of its own, the rest is its address
+#define TRACE_MAPPED  0x8000000000000000ULL
+
+typedef struct {
+   uint64_t op;       // one of the TRACE_ codes
+   uint64_t size;
+   uint64_t offset;   // heap offset of the block returned or freed
+   uint64_t old;
+} TraceRecord;
+
+#endif
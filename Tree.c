@@ -6,39 +6,136 @@
 #include <assert.h>
 #include <string.h>
 #include "Tree.h"
+#include "Pool.h"
+#include "Arena.h"
 #include "myHeap.h"
 
 typedef struct node *Link;
 
+#ifdef COMPACT_TREE
+
+// built with -DCOMPACT_TREE, children are held as 32-bit offsets into the heap
+// every node lives in, 0 for none as no node can start the heap; a node takes
+// 12 bytes rather than 24, so twice as many share a cache line
+// nodes are at least 4-byte aligned, so the low bit of left is free to say
+// whether the node came from an arena
+typedef struct node {
+	Item value;
+	unsigned int left, right;
+} Node;
+
+#define ARENA_BIT 1u
+
+static char *nodeBase = NULL;  // start of the heap, found from each node made
+
+static inline unsigned int linkTo(Link t)
+{
+	return (t == NULL) ? 0 : (char *)t - nodeBase;
+}
+
+#define leftOf(t)  (((t)->left & ~ARENA_BIT) == 0 ? NULL : (Link) (nodeBase + ((t)->left & ~ARENA_BIT)))
+#define rightOf(t) ((t)->right == 0 ? NULL : (Link) (nodeBase + (t)->right))
+#define setLeft(t,c)  ((t)->left = linkTo(c) | ((t)->left & ARENA_BIT))
+#define setRight(t,c) ((t)->right = linkTo(c))
+#define fromArena(t)  ((t)->left & ARENA_BIT)
+#define initNode(t,inArena) ((t)->left = (inArena) ? ARENA_BIT : 0, (t)->right = 0)
+
+#else
+
 typedef struct node {
 	Item value;
+	char inArena;  // non-zero if the node came from an arena, not the pool
 	Link left, right;
 } Node;
 
+#define leftOf(t)  ((t)->left)
+#define rightOf(t) ((t)->right)
+#define setLeft(t,c)  ((t)->left = (c))
+#define setRight(t,c) ((t)->right = (c))
+#define fromArena(t)  ((t)->inArena)
+#define initNode(t,arena) ((t)->inArena = (arena), (t)->left = (t)->right = NULL)
+
+#endif
+
+static Pool nodePool = NULL;    // every Node comes from here
+static int poolHeap;            // myHeapNumber of the heap nodePool is in
+static int poolNodes = 0;       // nodes out of nodePool, it goes back to the heap with the last
+static Arena nodeArena = NULL;  // unless trees are being built in an arena
+
 // make a new node containing a value
 static
 Link newNode(int v)
 {
-	Link new = myMalloc(sizeof(Node));
+	Link new;
+	if (nodeArena != NULL)
+		new = arenaAlloc(nodeArena, sizeof(Node));
+	else {
+		// a pool left from a heap since freed went with it, along with its nodes
+		if (nodePool != NULL && poolHeap != myHeapNumber()) nodePool = NULL;
+		if (nodePool == NULL) {
+			nodePool = newPool(sizeof(Node));
+			poolHeap = myHeapNumber();
+			poolNodes = 0;
+		}
+		assert(nodePool != NULL);
+		new = poolAlloc(nodePool);
+		if (new != NULL) poolNodes++;
+	}
 	assert(new != NULL);
+#ifdef COMPACT_TREE
+	long offset = heapOffset(new);  // nodes are reached from nodeBase, so must be in the heap
+	assert(offset > 0 && offset <= 0xFFFFFFFFL && (offset & ARENA_BIT) == 0);
+	nodeBase = (char *)new - offset;
+#endif
 	new->value = v;
-	new->left = new->right = NULL;
+	initNode(new, nodeArena != NULL);
 	return new;
 }
 
+// give back a node, one from an arena waits for the arena to be reset
+static
+void freeNode(Link t)
+{
+	if (fromArena(t)) return;
+	poolFree(nodePool, t);
+	if (--poolNodes == 0) {
+		dropPool(nodePool);
+		nodePool = NULL;
+	}
+}
+
+// build trees in an arena from now on, or in the node pool again if NULL
+void treeUseArena(Arena a)
+{
+	nodeArena = a;
+}
+
 // create a new empty Tree
 Tree newTree()
 {
 	return NULL;
 }
 
+// give back the nodes of a tree that came from the pool, returns one that came from an arena or NULL
+static
+Link dropNodes(Link t)
+{
+	if (t == NULL) return NULL;
+	Link left = dropNodes(leftOf(t));
+	Link right = dropNodes(rightOf(t));
+	if (fromArena(t)) return t;
+	freeNode(t);
+	return (left != NULL) ? left : right;
+}
+
 // free memory associated with Tree
 void dropTree(Tree t)
 {
 	if (t == NULL) return;
-	dropTree(t->left);
-	dropTree(t->right);
-	myFree(t);
+	// with no pool nodes anywhere, the tree is all in an arena and need not be walked
+	Link inArena = (poolNodes == 0 && fromArena(t)) ? t : dropNodes(t);
+	if (inArena != NULL && nodeArena != NULL && arenaOwns(nodeArena, inArena))
+		arenaReset(nodeArena);  // one reset frees every node at once
 }
 
 // display a Tree (sideways)
@@ -54,8 +151,8 @@ int depth(Tree t)
 	if (t == NULL)
 		return 0;
 	else {
-		int ld = depth(t->left);
-		int rd = depth(t->right);
+		int ld = depth(leftOf(t));
+		int rd = depth(rightOf(t));
 		return 1 + ((ld > rd)?ld:rd);
 	}
 }
@@ -64,7 +161,7 @@ int depth(Tree t)
 int nnodes(Tree t)
 {
 	if (t == NULL) return 0;
-	return 1 + nnodes(t->left) + nnodes(t->right);
+	return 1 + nnodes(leftOf(t)) + nnodes(rightOf(t));
 }
 
 // insert a new value into a Tree
@@ -75,9 +172,9 @@ Tree insert(Tree t, Item it)
 	if (diff == 0)
 		t->value = it;
 	else if (diff < 0)
-		t->left = insert(t->left, it);
+		setLeft(t, insert(leftOf(t), it));
 	else if (diff > 0)
-		t->right = insert(t->right, it);
+		setRight(t, insert(rightOf(t), it));
 	return t;
 }
 
@@ -88,12 +185,12 @@ Tree insertAtRoot(Tree t, Item it)
    if (diff == 0)
       t->value = it;
    else if (diff < 0) {
-      t->left = insertAtRoot(t->left, it);
+      setLeft(t, insertAtRoot(leftOf(t), it));
       //printf("rotateR(%d)\n",t->value);
       t = rotateR(t);
    }
    else if (diff > 0) {
-      t->right = insertAtRoot(t->right, it);
+      setRight(t, insertAtRoot(rightOf(t), it));
       //printf("rotateL(%d)\n",t->value);
       t = rotateL(t);
    }
@@ -117,9 +214,9 @@ int find(Tree t, Key k)
 	if (t == NULL) return 0;
 	int res, diff = cmp(k,t->value);
 	if (diff < 0)
-		res = find(t->left, k);
+		res = find(leftOf(t), k);
 	else if (diff > 0)
-		res = find(t->right, k);
+		res = find(rightOf(t), k);
 	else // (diff == 0)
 		res = 1;
 	return res;
@@ -136,9 +233,9 @@ Tree delete(Tree t, Key k)
 	if (diff == 0)
 		t = deleteRoot(t);
 	else if (diff < 0)
-		t->left = delete(t->left, k);
+		setLeft(t, delete(leftOf(t), k));
 	else if (diff > 0)
-		t->right = delete(t->right, k);
+		setRight(t, delete(rightOf(t), k));
 	return t;
 }
 
@@ -147,20 +244,20 @@ Tree deleteRoot(Tree t)
 {
 	Link newRoot;
 	// if no subtrees, tree empty after delete
-	if (t->left == NULL && t->right == NULL) {
-		myFree(t);
+	if (leftOf(t) == NULL && rightOf(t) == NULL) {
+		freeNode(t);
 		return NULL;
 	}
 	// if only right subtree, make it the new root
-	else if (t->left == NULL && t->right != NULL) {
-		newRoot = t->right;
-		myFree(t);
+	else if (leftOf(t) == NULL && rightOf(t) != NULL) {
+		newRoot = rightOf(t);
+		freeNode(t);
 		return newRoot;
 	}
 	// if only left subtree, make it the new root
-	else if (t->left != NULL && t->right == NULL) {
-		newRoot = t->left;
-		myFree(t);
+	else if (leftOf(t) != NULL && rightOf(t) == NULL) {
+		newRoot = leftOf(t);
+		freeNode(t);
 		return newRoot;
 	}
 	else {  // (t->left != NULL && t->right != NULL)
@@ -168,9 +265,9 @@ Tree deleteRoot(Tree t)
 		// - find inorder successor (grab value)
 		// - delete inorder successor node
 		// - move its value to root
-		Link succ = t->right; // not null!
-		while (succ->left != NULL) {
-			succ = succ->left;
+		Link succ = rightOf(t); // not null!
+		while (leftOf(succ) != NULL) {
+			succ = leftOf(succ);
 		}
 		int succVal = succ->value;
 		t = delete(t,succVal);
@@ -182,20 +279,20 @@ Tree deleteRoot(Tree t)
 Link rotateR(Link n1)
 {
    if (n1 == NULL) return n1;
-   Link n2 = n1->left;
+   Link n2 = leftOf(n1);
    if (n2 == NULL) return n1;
-   n1->left = n2->right;
-   n2->right = n1;
+   setLeft(n1, rightOf(n2));
+   setRight(n2, n1);
    return n2;
 }
 
 Link rotateL(Link n2)
 {
    if (n2 == NULL) return n2;
-   Link n1 = n2->right;
+   Link n1 = rightOf(n2);
    if (n1 == NULL) return n2;
-   n2->right = n1->left;
-   n1->left = n2;
+   setRight(n2, leftOf(n1));
+   setLeft(n1, n2);
    return n1;
 }
 
@@ -203,13 +300,13 @@ Tree partition(Tree t, int i)
 {
    if (t == NULL) return NULL;
    assert(0 <= i && i < nnodes(t));
-   int n = nnodes(t->left);
+   int n = nnodes(leftOf(t));
    if (i < n) {
-      t->left = partition(t->left, i);
+      setLeft(t, partition(leftOf(t), i));
       t = rotateR(t);
    }
    if (i > n) {
-      t->right = partition(t->right, i-n-1);
+      setRight(t, partition(rightOf(t), i-n-1));
       t = rotateL(t);
    }
    return t;
@@ -219,9 +316,9 @@ Item *get_ith(Tree t, int i)
 {
    if (t == NULL) return NULL;
    assert(0 <= i && i < nnodes(t));
-   int n = nnodes(t->left); // #nodes to left of root
-   if (i < n) return get_ith(t->left, i);
-   if (i > n) return get_ith(t->right, i-n-1);
+   int n = nnodes(leftOf(t)); // #nodes to left of root
+   if (i < n) return get_ith(leftOf(t), i);
+   if (i > n) return get_ith(rightOf(t), i-n-1);
    return &(t->value);
 }
 
@@ -233,8 +330,8 @@ Tree rebalance(Tree t)
     // put node with median key at root
     t = partition(t, nnodes(t)/2);
     // then rebalance each subtree
-    t->left = rebalance(t->left);
-    t->right = rebalance(t->right);
+    setLeft(t, rebalance(leftOf(t)));
+    setRight(t, rebalance(rightOf(t)));
     return t;
 }
 
@@ -282,12 +379,16 @@ int gap = 3;  // gap between left and right nodes
 //this is the x coordinate of the next char printed
 int print_next;    
 
+static Arena asciiArena = NULL;  // every asciinode comes from here while a tree is shown
+
 //prints ascii tree for given Tree structure
 void doShowTree(Tree t)
 {
 	asciinode *proot;
 	int xmin, i;
 	if (t == NULL) return;
+	asciiArena = newArena(64*sizeof(asciinode));
+	assert(asciiArena != NULL);
 	proot = build_ascii_tree(t);
 	compute_edge_lengths(proot);
 	for (i = 0; i < proot->height && i < MAX_HEIGHT; i++)
@@ -417,9 +518,9 @@ asciinode *build_ascii_tree_recursive(Tree t)
 	asciinode * node;
 
 	if (t == NULL) return NULL;
-	node = myMalloc(sizeof(asciinode));
-	node->left = build_ascii_tree_recursive(t->left);
-	node->right = build_ascii_tree_recursive(t->right);
+	node = arenaAlloc(asciiArena, sizeof(asciinode));
+	node->left = build_ascii_tree_recursive(leftOf(t));
+	node->right = build_ascii_tree_recursive(rightOf(t));
 	if (node->left != NULL) node->left->parent_dir = -1;
 	if (node->right != NULL) node->right->parent_dir = 1;
 	sprintf(node->label, "%d", t->value);
@@ -438,13 +539,12 @@ asciinode *build_ascii_tree(Tree t)
 	return node;
 }
 
-//Free all the nodes of the given tree
+//Free all the nodes of the given tree, along with asciiArena they all came from
 void free_ascii_tree(asciinode *node)
 {
 	if (node == NULL) return;
-	free_ascii_tree(node->left);
-	free_ascii_tree(node->right);
-	myFree(node);
+	dropArena(asciiArena);
+	asciiArena = NULL;
 }
 
 //The following function fills in the lprofile array for the given tree.
@@ -4,6 +4,8 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include "Arena.h"
+
 typedef struct node *Tree;
 
 typedef int Key;
@@ -19,6 +21,11 @@ typedef Key Item; // item is just a key
 Tree newTree();
 // free memory associated with Tree
 void dropTree(Tree);
+// build Trees in an Arena from now on (NULL to stop); such Trees share
+// the arena's fate, so dropping any one of them resets the whole arena if
+// it is still in use; a node goes back to wherever it came from, so a tree
+// may be edited after switching
+void treeUseArena(Arena);
 // display a Tree
 void showTree(Tree);
 
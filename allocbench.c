@@ -0,0 +1,355 @@
+// COMP1521 18s1 Assignment 2
+// myHeap benchmark: synthetic workloads run against myHeap, under each placement policy, with compact headers
+// and with big blocks mapped apart, and the system malloc
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <malloc.h>
+#include "myHeap.h"
+
+#define HEAPSIZE  (512*1024*1024)
+#define GROWBY    4096         // myHeap starts this big and grows in steps of it, so its size shows its footprint
+#define NCALLS    2000000      // allocator calls per workload run
+#define NSAMPLES  (1 << 20)    // latencies kept per run
+
+typedef struct {
+   char *name;
+   void  (*start)(void);
+   void *(*alloc)(int size);
+   void  (*release)(void *p);
+   long  (*inUse)(void);       // bytes the allocator holds for live blocks, overhead included
+   long  (*footprint)(void);   // bytes the allocator has taken from the system, free space included, or NULL
+   void  (*stop)(void);
+   int   policy;               // placement policy, thresholds and header format for myHeap
+   size_t highAbove;
+   int   compact;
+   size_t mapAbove;
+} Allocator;
+
+static Allocator *A;
+
+// ---------- allocators
+
+static Heap heap;
+
+static void heapStart(void)
+{
+   HeapConfig config = { .size = GROWBY, .maxSize = HEAPSIZE, .growBy = GROWBY, .mapped = 1,
+                         .policy = A->policy, .highAbove = A->highAbove, .compact = A->compact,
+                         .mapAbove = A->mapAbove };
+   heap = heapCreateWith(&config);
+   if (heap == NULL) {
+      printf("Can't create heap\n");
+      exit(1);
+   }
+}
+static void *heapAlloc(int size) { return heapMalloc(heap, size); }
+static void heapRelease(void *p) { heapFree(heap, p); }
+static long heapInUse(void)
+{
+   HeapStats s;
+   heapStats(heap, &s);
+   return s.allocBytes + s.mappedBytes;
+}
+static long heapFootprint(void)
+{
+   HeapStats s;
+   heapStats(heap, &s);
+   return s.size + s.mappedBytes;
+}
+static void heapStop(void) { heapDestroy(heap); }
+
+static void sysStart(void) { malloc_trim(0); }
+static void *sysAlloc(int size) { return malloc(size); }
+static void sysRelease(void *p) { free(p); }
+static long sysInUse(void)
+{
+   struct mallinfo2 m = mallinfo2();
+   return m.uordblks + m.hblkhd;
+}
+static void sysStop(void) { malloc_trim(0); }
+
+static Allocator allocators[] = {
+   { "best", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_BEST_FIT },
+   { "first", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_FIRST_FIT },
+   { "next", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_NEXT_FIT },
+   { "best/hi", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_BEST_FIT, 1024 },
+   { "compact", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_BEST_FIT, 0, 1 },
+   { "mapped", heapStart, heapAlloc, heapRelease, heapInUse, heapFootprint, heapStop, HEAP_BEST_FIT, 0, 0, 32768 },
+   { "malloc", sysStart, sysAlloc, sysRelease, sysInUse, NULL, sysStop },   // its arena holds the benchmark's blocks too
+};
+
+// ---------- measurement
+
+static int timing;           // time every call, else count them only
+static long calls;
+static int *lat;
+static int nLat;
+static long live, peakLive, baseUse, peakUse, peakFoot;
+
+static long nanos(void)
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+// allocate size bytes, the first word remembers the size for bfree
+static void *balloc(int size)
+{
+   void *p;
+   if (timing) {
+      long t0 = nanos();
+      p = A->alloc(size);
+      long t = nanos() - t0;
+      if (nLat < NSAMPLES) lat[nLat++] = t;
+      live += size;
+      if (live > peakLive) peakLive = live;
+      if ((calls & 1023) == 0) {             // checking every call would swamp the workload
+         long use = A->inUse() - baseUse;
+         if (use > peakUse) peakUse = use;
+         long foot = (A->footprint == NULL) ? 0 : A->footprint();
+         if (foot > peakFoot) peakFoot = foot;
+      }
+   }
+   else {
+      p = A->alloc(size);
+   }
+   if (p == NULL) {
+      printf("%s ran out of memory\n", A->name);
+      exit(1);
+   }
+   *(int *)p = size;
+   calls++;
+   return p;
+}
+
+static void bfree(void *p)
+{
+   if (timing) {
+      live -= *(int *)p;
+      long t0 = nanos();
+      A->release(p);
+      long t = nanos() - t0;
+      if (nLat < NSAMPLES) lat[nLat++] = t;
+   }
+   else {
+      A->release(p);
+   }
+   calls++;
+}
+
+// ---------- workloads, each makes about NCALLS allocator calls and frees everything
+
+static unsigned int seed;
+static int rnd(int n) { return rand_r(&seed) % n; }
+
+// sizes with a long tail: mostly small, occasionally up to 64K
+static int powerLaw(void)
+{
+   double u = (rand_r(&seed) + 1.0) / (RAND_MAX + 2.0);
+   double s = 16 / pow(u, 1/1.2);
+   return (s > 65536) ? 65536 : (int) s;
+}
+
+typedef struct cell { int size; int key; struct cell *next; } Cell;
+
+// a short sorted list, with random inserts and deletes
+static void sortedList(void)
+{
+   Cell *head = NULL;
+   while (calls < NCALLS) {
+      int key = rnd(512);
+      Cell **pp = &head;
+      while (*pp != NULL && (*pp)->key < key) pp = &(*pp)->next;
+      if (*pp != NULL && (*pp)->key == key) {
+         Cell *old = *pp;
+         *pp = old->next;
+         bfree(old);
+      }
+      else {
+         Cell *c = balloc(sizeof(Cell) + rnd(32));
+         c->key = key;
+         c->next = *pp;
+         *pp = c;
+      }
+   }
+   while (head != NULL) {
+      Cell *next = head->next;
+      bfree(head);
+      head = next;
+   }
+}
+
+typedef struct node { int size; int key; struct node *left, *right; } Node;
+
+static Node *treeDelete(Node *t, int key)
+{
+   if (t == NULL) return NULL;
+   if (key < t->key) t->left = treeDelete(t->left, key);
+   else if (key > t->key) t->right = treeDelete(t->right, key);
+   else if (t->left == NULL || t->right == NULL) {
+      Node *child = (t->left != NULL) ? t->left : t->right;
+      bfree(t);
+      return child;
+   }
+   else {
+      Node *min = t->right;
+      while (min->left != NULL) min = min->left;
+      t->key = min->key;
+      t->right = treeDelete(t->right, min->key);
+   }
+   return t;
+}
+
+static void treeDrop(Node *t)
+{
+   if (t == NULL) return;
+   treeDrop(t->left);
+   treeDrop(t->right);
+   bfree(t);
+}
+
+// binary search tree of up to 64K keys, inserts and deletes at random as in test4
+static void tree(void)
+{
+   Node *root = NULL;
+   while (calls < NCALLS) {
+      int key = rnd(65536);
+      Node **pp = &root;
+      while (*pp != NULL && (*pp)->key != key) pp = (key < (*pp)->key) ? &(*pp)->left : &(*pp)->right;
+      if (*pp != NULL) {
+         root = treeDelete(root, key);
+      }
+      else {
+         Node *n = balloc(sizeof(Node));
+         n->key = key;
+         n->left = n->right = NULL;
+         *pp = n;
+      }
+   }
+   treeDrop(root);
+}
+
+// random sizes up to 4K, freed in random order
+static void randomSizes(void)
+{
+   static void *slot[4096];
+   while (calls < NCALLS) {
+      int i = rnd(4096);
+      if (slot[i] == NULL) slot[i] = balloc(8 + rnd(4089));
+      else {
+         bfree(slot[i]);
+         slot[i] = NULL;
+      }
+   }
+   for (int i = 0; i < 4096; i++) {
+      if (slot[i] != NULL) bfree(slot[i]);
+      slot[i] = NULL;
+   }
+}
+
+// a queue: blocks are freed in the order they were made, after a long lifetime
+static void producerConsumer(void)
+{
+   static void *queue[16384];
+   int head = 0, tail = 0, n = 0;
+   while (calls < NCALLS) {
+      if (n < 16384 && (n < 8192 || rnd(2))) {
+         queue[tail] = balloc(16 + rnd(240));
+         tail = (tail + 1) % 16384;
+         n++;
+      }
+      else {
+         bfree(queue[head]);
+         head = (head + 1) % 16384;
+         n--;
+      }
+   }
+   for (; n > 0; n--) {
+      bfree(queue[head]);
+      head = (head + 1) % 16384;
+   }
+}
+
+// power-law sizes, freed in random order
+static void powerLawSizes(void)
+{
+   static void *slot[8192];
+   while (calls < NCALLS) {
+      int i = rnd(8192);
+      if (slot[i] == NULL) slot[i] = balloc(powerLaw());
+      else {
+         bfree(slot[i]);
+         slot[i] = NULL;
+      }
+   }
+   for (int i = 0; i < 8192; i++) {
+      if (slot[i] != NULL) bfree(slot[i]);
+      slot[i] = NULL;
+   }
+}
+
+static struct {
+   char *name;
+   void (*run)(void);
+} workloads[] = {
+   { "sorted list", sortedList },
+   { "tree", tree },
+   { "random sizes", randomSizes },
+   { "producer/consumer", producerConsumer },
+   { "power-law sizes", powerLawSizes },
+};
+
+static int byValue(const void *a, const void *b)
+{
+   int x = *(int *)a, y = *(int *)b;
+   return (x > y) - (x < y);
+}
+
+// run one workload twice: once untimed for throughput, once timing every call
+static void measure(int w, Allocator *a)
+{
+   A = a;
+   A->start();
+   seed = 1;
+   calls = 0;
+   timing = 0;
+   long t0 = nanos();
+   workloads[w].run();
+   double secs = (nanos() - t0) / 1e9;
+   double mops = calls / secs / 1e6;
+   A->stop();
+
+   A->start();
+   seed = 1;
+   calls = nLat = 0;
+   live = peakLive = peakUse = peakFoot = 0;
+   baseUse = A->inUse();                     // the benchmark's own blocks in the system heap
+   timing = 1;
+   workloads[w].run();
+   A->stop();
+   qsort(lat, nLat, sizeof(int), byValue);
+   printf("%-18s %-7s %9.2f %7d %7d %8d %9.1f%%", workloads[w].name, A->name, mops,
+          lat[nLat/2], lat[(int) (nLat*0.99)], lat[(int) (nLat*0.999)],
+          100.0 * (peakUse - peakLive) / peakLive);
+   if (A->footprint == NULL)
+      printf(" %10s\n", "-");
+   else
+      printf(" %9.1f%%\n", 100.0 * (peakFoot - peakLive) / peakLive);
+}
+
+int main(int argc, char *argv[])
+{
+   lat = malloc(NSAMPLES * sizeof(int));
+   printf("%-18s %-7s %9s %7s %7s %8s %10s %10s\n", "workload", "alloc", "Mcalls/s",
+          "p50 ns", "p99 ns", "p999 ns", "overhead", "footprint");
+   for (int w = 0; w < sizeof(workloads)/sizeof(workloads[0]); w++)
+      for (int a = 0; a < sizeof(allocators)/sizeof(allocators[0]); a++)
+         measure(w, &allocators[a]);
+   return 0;
+}
@@ -0,0 +1,115 @@
+// COMP1521 18s1 Assignment 2
+// myHeap benchmark: malloc/free throughput as the number of threads grows
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "myHeap.h"
+
+#define HEAPSIZE  (64*1024*1024)
+#define NSLOTS    256   // live chunks per thread
+#define NSHARED   64    // slots for handing chunks to other threads
+#define MAXTHREAD 64
+
+typedef struct {
+   Heap heap;
+   int  locked;         // serialise every call behind one mutex
+   long ops;
+   unsigned int seed;
+} Worker;
+
+static void *shared[NSHARED];
+static pthread_mutex_t bigLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *doMalloc(Worker *w, int size)
+{
+   if (!w->locked) return heapMalloc(w->heap, size);
+   pthread_mutex_lock(&bigLock);
+   void *p = heapMalloc(w->heap, size);
+   pthread_mutex_unlock(&bigLock);
+   return p;
+}
+
+static void doFree(Worker *w, void *p)
+{
+   if (p == NULL) return;
+   if (!w->locked) { heapFree(w->heap, p); return; }
+   pthread_mutex_lock(&bigLock);
+   heapFree(w->heap, p);
+   pthread_mutex_unlock(&bigLock);
+}
+
+// random small allocations and frees; one free in eight swaps the chunk
+// into the shared slots instead, and frees whatever another thread left there
+static void *work(void *arg)
+{
+   Worker *w = arg;
+   void *slots[NSLOTS] = { NULL };
+   for (long i = 0; i < w->ops; i++) {
+      int r = rand_r(&w->seed);
+      int s = r % NSLOTS;
+      if (slots[s] == NULL) {
+         slots[s] = doMalloc(w, 8 + (r >> 8) % 120);
+      }
+      else if ((r >> 16) % 8 == 0) {
+         void *old = __atomic_exchange_n(&shared[(r >> 8) % NSHARED], slots[s], __ATOMIC_ACQ_REL);
+         doFree(w, old);
+         slots[s] = NULL;
+      }
+      else {
+         doFree(w, slots[s]);
+         slots[s] = NULL;
+      }
+   }
+   for (int s = 0; s < NSLOTS; s++) doFree(w, slots[s]);
+   return NULL;
+}
+
+static double run(int nthreads, int locked, long ops)
+{
+   HeapConfig config = { .size = HEAPSIZE, .concurrent = !locked };
+   Heap heap = heapCreateWith(&config);
+   if (heap == NULL) {
+      printf("Can't create heap\n");
+      exit(1);
+   }
+   pthread_t tid[MAXTHREAD];
+   Worker w[MAXTHREAD];
+   struct timespec t0, t1;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for (int i = 0; i < nthreads; i++) {
+      w[i] = (Worker){ .heap = heap, .locked = locked, .ops = ops, .seed = 1 + i };
+      pthread_create(&tid[i], NULL, work, &w[i]);
+   }
+   for (int i = 0; i < nthreads; i++) pthread_join(tid[i], NULL);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   for (int i = 0; i < NSHARED; i++) {
+      if (shared[i] != NULL) heapFree(heap, shared[i]);
+      shared[i] = NULL;
+   }
+   heapDestroy(heap);
+   double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+   return nthreads*ops/secs/1e6;
+}
+
+int main(int argc, char *argv[])
+{
+   long ops = (argc > 1) ? atol(argv[1]) : 2000000;
+   int maxThreads = (argc > 2) ? atoi(argv[2]) : 8;
+   if (ops < 1 || maxThreads < 1 || maxThreads > MAXTHREAD) {
+      printf("Usage: %s [OpsPerThread [MaxThreads]]\n", argv[0]);
+      exit(1);
+   }
+
+   printf("%7s %14s %14s %8s\n", "threads", "locked Mop/s", "cached Mop/s", "scaling");
+   double base = 0;
+   for (int n = 1; n <= maxThreads; n *= 2) {
+      double locked = run(n, 1, ops);
+      double cached = run(n, 0, ops);
+      if (n == 1) base = cached;
+      printf("%7d %14.2f %14.2f %7.2fx\n", n, locked, cached, cached/base);
+   }
+   return 0;
+}
@@ -1,260 +1,2226 @@
-
 // COMP1521 18s1 Assignment 2
 // Implementation of heap management system
 // Completed by Johannes So (z5164638) 13/5/2018
 
+#define _DEFAULT_SOURCE
+#define MYHEAP_SOURCE                                                       // the calls below are the functions, not the profiling macros
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include "myHeap.h"
+#include "Trace.h"
 
 // minimum total space for heap
 #define MIN_HEAP  4096
-// minimum amount of space for a free Chunk (includes\\\ Header)
-#define MIN_CHUNK 32
+// bytes beyond its index node and footer that excess space needs before it is split off as a free Chunk
+#define MIN_SPARE 8
 
 #define ALLOC     0x55555555
 #define FREE      0xAAAAAAAA
+#define CACHED    0x5A5A5A5A                                                // allocated, but parked in a thread cache, a quick list or the pending stack
+
+// offset used to mark an empty link in the free-chunk index
+#define NONE      ((Size) -1)
+
+// low bit of the size in a Header, set when the physically previous chunk is free
+#define PREV_FREE 0x1
+#define SIZE_BITS 0x3
+
+// a heap that may reach WIDE_MIN bytes has offsets too big for 32 bits, so it uses wide chunk headers
+#define WIDE_MIN  (((Size) 1 << 32) - MIN_HEAP)
+
+// a compact heap packs a chunk's header into one word: its size, PREV_FREE and these
+#define IN_USE      0x2                                                     // allocated or parked
+#define PARKED      0x80000000                                              // parked on a quick list
+#define PARITY      0x40000000                                              // keeps the number of set bits even, so most stray writes show
+#define COMPACT_MAX ((Size) 1 << 30)                                        // sizes must leave the top two bits free
+
+// free chunks are binned by size: one bin per size below SMALL_MAX, then two bins per power of two
+#define SMALL_MAX 256
+#define NSMALL    (SMALL_MAX/4)
+#define NBINS     (NSMALL + 2*(64 - 8))
+
+// thread caches of concurrent heaps keep up to CACHE_MAX chunks of each size below SMALL_MAX
+#define CACHE_MAX  32
+#define CACHE_FILL 8                                                        // chunks fetched from the bins when a cache runs dry
+
+// small chunks freed into a heap that is not concurrent wait, uncoalesced, on a quick list for their size
+// until a request cannot be met from the bins, a list holds at most QUICK_DEPTH chunks
+#define QUICK_MAX   64
+#define NQUICK      (QUICK_MAX/4)
+#define QUICK_DEPTH 32
+
+// counters heapStats reads without taking the heap's lock, each changed by one thread at a time with a single store
+#define COUNT(field,n) __atomic_store_n(&(field),(field) + (n),__ATOMIC_RELAXED)
+#define STORE(field,v) __atomic_store_n(&(field),(v),__ATOMIC_RELAXED)
+#define PEEK(field)    __atomic_load_n(&(field),__ATOMIC_RELAXED)
+
+// a mapped heap hands the pages inside free chunks of at least TRIM_MIN bytes back to the
+// system, checking again each time another TRIM_EVERY bytes have been freed
+#define TRIM_MIN   65536
+#define TRIM_EVERY (1 << 20)
+
+// first word of a file holding a heap
+#define HEAP_MAGIC 0x48454150
 
 typedef unsigned int uint;                                                  // counters, bit-strings, ...
 
+typedef size_t Size;                                                        // byte counts and offsets within a heap
+
 typedef void *Addr;                                                         // addresses
 
 typedef struct {                                                            // headers for Chunks
     uint  status;                                                           // status (ALLOC or FREE)
-    uint  size;                                                             // #bytes, including header
+    uint  size;                                                             // #bytes, including header (low bits hold PREV_FREE)
 } Header;
 
-static Addr  heapMem;                                                       // space allocated for Heap
-static int   heapSize;                                                      // number of bytes in heapMem
-static Addr *freeList;                                                      // array of pointers to free chunks
-static int   freeElems;                                                     // number of elements in freeList[]
-static int   nFree;                                                         // number of free chunks
+typedef struct {                                                            // headers for Chunks of a wide heap, with 64-bit sizes
+    uint  status;
+    uint  unused;                                                           // keeps size 8-byte aligned
+    Size  size;
+} WideHeader;
+
+// every free Chunk ends with a boundary tag, a copy of its size (a uint, or a Size in a wide heap)
+
+typedef struct {                                                            // free Chunks double as nodes of their bin's AVL tree
+    Header hdr;
+    uint   left;                                                            // offset of left subtree (smaller, or same size and lower address) or NONE
+    uint   right;                                                           // offset of right subtree (larger, or same size and higher address) or NONE
+    int    height;                                                          // height of subtree rooted at this chunk
+    uint   largest;                                                         // size of the biggest chunk in that subtree, kept in address-ordered bins
+} FreeChunk;
+
+typedef struct {                                                            // the same in a wide heap
+    WideHeader hdr;
+    Size   left;
+    Size   right;
+    int    height;
+    Size   largest;
+} WideFreeChunk;
+
+typedef struct {                                                            // the same in a compact heap
+    uint   word;                                                            // size with PREV_FREE, IN_USE, PARKED and PARITY bits
+    uint   left;
+    uint   right;
+    int    height;
+    uint   largest;
+} CompactFreeChunk;
+
+typedef struct {                                                            // metadata block at the start of a heap file, the chunks follow it
+    uint  magic;                                                            // HEAP_MAGIC
+    uint  align;                                                            // alignment the heap was created with
+    uint  clean;                                                            // non-zero if the fields below were saved when the heap was closed
+    uint  lastFree;
+    uint  byAddress;                                                        // non-zero if the saved bins are in address order
+    uint  compact;                                                          // non-zero if chunks have one-word headers
+    uint  binMap[(NBINS + 31)/32];
+    Size  size;                                                             // number of bytes of chunks
+    Size  root;                                                             // offset of the application's root object, or NONE
+    Size  bins[NBINS];
+    Size  nFree;
+    Size  freeBytes;
+    Size  nChunks;
+    Size  touched;
+} HeapFile;
+
+typedef struct {                                                            // a block too big for the heap, in a mapping of its own
+    Addr  block;                                                            // start of the mapping, which is also the payload
+    Size  size;                                                             // bytes mapped, a whole number of pages
+} Mapping;
+
+typedef struct {                                                            // a call site seen by the allocation profiler
+    const char *name;                                                       // "file:line", or "?" for a call that did not say
+    long  allocs;                                                           // sampled allocations, and the bytes they stand for
+    long  bytes;
+    long  liveAllocs;                                                       // the same for those not freed yet
+    long  liveBytes;
+} Site;
+
+typedef struct {                                                            // a sampled block that is still allocated
+    Addr  block;                                                            // NULL in an empty slot
+    int   site;                                                             // index in the heap's sites
+    Size  weight;                                                           // bytes it stands for
+} Sample;
+
+typedef struct threadCache {                                                // one thread's stock of small chunks for a concurrent heap
+    Heap  heap;                                                             // heap the chunks belong to
+    Size  head[NSMALL];                                                     // offset of first cached chunk of each size class, or NONE
+    int   count[NSMALL];                                                    // number of chunks cached in each size class
+    long  mallocs;                                                          // allocations and frees served by this cache, for heapStats
+    long  frees;
+    int   parked;                                                           // its thread has exited, it waits empty for another to take it over
+    struct threadCache *next;                                               // next cache of the same heap, set before the cache is linked in
+} ThreadCache;
+
+struct heap {                                                               // state of one heap instance
+    Addr  base;                                                             // start of the malloc'd or mapped region holding mem
+    Addr  mem;                                                              // space allocated for Heap
+    Size  size;                                                             // number of bytes in mem
+    Size  maxSize;                                                          // size a growable heap may extend to, equal to size otherwise
+    Size  growBy;                                                           // bytes added per extension, 0 to double
+    size_t reserved;                                                        // bytes of address space mapped at base, 0 if malloc'd
+    Size  freed;                                                            // bytes freed into a mapped heap since it was last trimmed
+    HeapFile *file;                                                         // metadata block of a file-backed heap, NULL otherwise
+    int   fd;                                                               // the heap file, kept open to hold its lock
+    Size  root;                                                             // offset of the application's root object, or NONE
+    FILE *trace;                                                            // every call is recorded here, if not NULL
+    int   lastFree;                                                         // non-zero if the last chunk in mem is free
+    int   align;                                                            // every chunk size and payload address is a multiple of this
+
+    int   wide;                                                             // non-zero if chunks have WideHeaders
+    int   compact;                                                          // non-zero if chunks have one-word headers, see IN_USE
+    int   hdr;                                                              // bytes of header in front of each payload
+    int   tag;                                                              // bytes of boundary tag at the end of a free chunk
+    int   node;                                                             // bytes of a free chunk's header and index links
+    Size  minFree;                                                          // smallest chunk that can hold an index node plus its footer
+    Size  minChunk;                                                         // smallest excess worth splitting off as a free chunk
+
+    int   policy;                                                           // HEAP_BEST_FIT, HEAP_FIRST_FIT or HEAP_NEXT_FIT
+    Size  rover;                                                            // where a next-fit search starts
+    Size  highAbove;                                                        // requests this big or more are taken from the top of their chunk, 0 for never
+    Size  bins[NBINS];                                                      // offset of root of each bin's tree, ordered by size then address, or address alone unless best-fit
+    uint  binMap[(NBINS + 31)/32];                                          // bit per bin, set when the bin is non-empty
+    Size  nFree;                                                            // number of free chunks
+    Size  freeBytes;                                                        // bytes in free chunks
+    Size  nChunks;                                                          // number of chunks of every kind
+    int   freeBySize[64];                                                   // free chunks by position of the top bit of their size
+    Size  largest;                                                          // size of the biggest chunk in the bins, 0 if there are none
+    long  mallocs;                                                          // events since the heap was created or opened, see heapStats
+    long  frees;                                                            // updated atomically in a concurrent heap
+    long  splits;
+    long  merges;
+    Size  touched;                                                          // every byte from here up is still zero from heap creation, bar free-chunk tags
+
+    Size  quick[NQUICK];                                                    // offset of the last CACHED chunk freed of each size below QUICK_MAX, or NONE
+    int   quickCount[NQUICK];                                               // number of chunks on each quick list
+    Size  quickBytes;                                                       // bytes in chunks on the quick lists
+
+    Size *handles;                                                          // offset of the chunk of each handle, or NONE if it is spare
+    int  *spare;                                                            // handles free for reuse
+    int   nHandles;                                                         // handles ever made, the table holds maxHandles
+    int   maxHandles;
+    int   nSpare;
+    Size  compactAt;                                                        // chunk where the next heapCompact call carries on
+
+    Size  mapAbove;                                                         // requests this big or more get a Mapping of their own, 0 for never
+    Mapping *maps;                                                          // every live Mapping, in no particular order
+    int   nMaps;
+    int   maxMaps;
+    Size  mappedBytes;                                                      // bytes in all of them
 
-static void sortFreeList();
-static int findSmallestChunk(int size);
-static void organiseNULL(int index);
-static int findAddressInFreeList(void *address);
-static void adjacentLeft(int index, void *address);
-static void adjacentRight(int index, void *address);
+    Size  sampleEvery;                                                      // bytes allocated per sampled allocation, 0 if not profiling
+    long  sampleLeft;                                                       // bytes to go until the next sample
+    Site *sites;                                                            // every call site with a sampled allocation
+    int   nSites;
+    int   maxSites;
+    Sample *samples;                                                        // live sampled blocks, open-addressed by address
+    int   nSamples;
+    int   maxSamples;                                                       // a power of two, kept at least twice nSamples
+
+    int   concurrent;                                                       // non-zero if the heap may be used by several threads at once
+    pthread_mutex_t lock;                                                   // guards the bins of a concurrent heap
+    pthread_key_t   cacheKey;                                               // each thread's ThreadCache for this heap
+    ThreadCache    *caches;                                                 // every thread cache, only added to, and under lock, until the heap goes
+    Size  pending;                                                          // lock-free stack of CACHED chunks waiting to go back to the bins, or NONE
+};
+
+static Heap  defaultHeap;                                                   // heap used by initHeap/myMalloc/myFree
+static int   defaultNumber;                                                 // counts the default heaps set up, see myHeapNumber
+
+static void traceCall(Heap h, uint op, Size size, void *block, Size old);
+static Size traceOffset(Heap h, void *block);
+static void *mallocBlock(Heap h, Size size);
+static void freeBlock(Heap h, void *block);
+static void *reallocBlock(Heap h, void *block, Size size);
+static int mallocBatch(Heap h, Size size, int count, void **out);
+static void freeBatch(Heap h, void **ptrs, int n);
+static void *callocBlock(Heap h, Size nelem, Size size);
+static void *memalignBlock(Heap h, Size alignment, Size size);
+static Size roundSize(Heap h, Size size);
+static void *allocChunk(Heap h, Size size);
+static void *quickMalloc(Heap h, int cls);
+static void quickFree(Heap h, Size offset, Size size);
+static void consolidate(Heap h);
+static Size findChunk(Heap h, Size size);
+static Size takeChunkHigh(Heap h, Size offset, Size have, Size want);
+static int growHeap(Heap h, Size need);
+static int commitSpace(Heap h, Size size);
+static void releaseSpace(Heap h);
+static void setLayout(Heap h, int wide, int compact);
+static int mapFile(Heap h, const char *path, Size *size, int *align);
+static void loadFile(Heap h);
+static void saveFile(Heap h);
+static void rebuildBins(Heap h);
+static void countTree(Heap h, Size root);
+static void trimHeap(Heap h);
+static void trimTree(Heap h, Size root);
+static void takeChunk(Heap h, Size offset, Size have, Size want);
+static void releaseChunk(Heap h, Size offset);
+static inline void forgetHeader(Heap h, Size gone, Size into);
+static void *mapBlock(Heap h, Size size);
+static void sampleAlloc(Heap h, void *block, Size size, const char *site);
+static void sampleFree(Heap h, void *block);
+static int siteOf(Heap h, const char *name);
+static int growSamples(Heap h);
+static Sample *slotOf(Heap h, Addr block);
+static void *remapBlock(Heap h, void *block, Size size);
+static int unmapBlock(Heap h, Addr block);
+static int findMapping(Heap h, Addr block);
+static Size mappedSize(Heap h, Addr block);
+static int newHandle(Heap h, Size offset);
+static int handleOf(Heap h, Size offset);
+static int resizeChunk(Heap h, Size offset, Size size);
+static void *cacheMalloc(Heap h, Size size);
+static void cacheFree(Heap h, Size offset);
+static ThreadCache *threadCache(Heap h);
+static void cacheExit(void *cache);
+static void flushCache(ThreadCache *cache);
+static void pushPending(Heap h, Size first, Size last);
+static void drainPending(Heap h);
+static Size linkOf(Heap h, Size offset);
+static void setLink(Heap h, Size offset, Size link);
+static inline char *chunkAt(Heap h, Size offset);
+static inline uint statusOf(Heap h, Size offset);
+static inline void setStatus(Heap h, Size offset, uint status);
+static inline Size sizeWord(Heap h, Size offset);
+static inline void setSizeWord(Heap h, Size offset, Size word);
+static inline Size chunkSize(Heap h, Size offset);
+static inline Size tagBelow(Heap h, Size offset);
+static inline uint *nodeOf(Heap h, Size offset);
+static inline Size leftOf(Heap h, Size offset);
+static inline Size rightOf(Heap h, Size offset);
+static inline void setLeft(Heap h, Size offset, Size link);
+static inline void setRight(Heap h, Size offset, Size link);
+static void markFree(Heap h, Size offset, Size size);
+static void setPrevFree(Heap h, Size offset, int isFree);
+static inline int topBit(Size size);
+static inline int binOf(Size size);
+static int nextBin(Heap h, int bin);
+static void addFree(Heap h, Size offset);
+static void removeFree(Heap h, Size offset);
+static Size findFit(Heap h, Size size);
+static Size findSmallestChunk(Heap h, Size size);
+static Size findFirstChunk(Heap h, Size size, Size from);
+static Size largestChunk(Heap h);
+static inline int keyBefore(Heap h, Size a, Size b);
+static Size treeFit(Heap h, Size root, Size size);
+static Size treeFirstFit(Heap h, Size root, Size size, Size from);
+static Size treeMin(Heap h, Size root);
+static Size treeInsert(Heap h, Size root, Size offset);
+static Size treeRemove(Heap h, Size root, Size offset);
+static Size treeRemoveMin(Heap h, Size root, Size *min);
+static Size rebalance(Heap h, Size root);
+static Size rotateLeft(Heap h, Size root);
+static Size rotateRight(Heap h, Size root);
+static inline int height(Heap h, Size root);
+static inline void fixHeight(Heap h, Size root);
+static inline Size largestIn(Heap h, Size root);
 
 // initialise heap
-int initHeap(int size) {
-    if (size < MIN_HEAP) size = MIN_HEAP;                                   // set size to minimum heap size if less than it
-    int remainder = size % 4;
-    if (remainder != 0) size = size + 4 - remainder;                        // round up to nearest multiple of 4 if not divisible by 4
-    
-    heapMem = (char *)malloc(size*sizeof(char));                            // set heapMem to first byte of malloc'd region
-    if (heapMem == NULL) return -1;
-    memset((char *)heapMem,'\0',size);                                      // zeroes out entire region
-    heapSize = size;
-    
-    freeList = malloc((size/MIN_CHUNK)*sizeof(Addr));                       // allocate freeList array
-    if (freeList == NULL) return -1;
-    freeElems = size/MIN_CHUNK;
-    for (int i = 0; i < freeElems; i++) {                                   // initialise freeList array to NULL addresses
-        freeList[i] = NULL;
-    }
-    
-    Header *newHeader = (Header *)heapMem;                                  // initialise region to be a single large free-space chunk
-    newHeader->status = FREE;
-    newHeader->size = size;
-    freeList[0] = heapMem;                                                  // set first item in freeList array to the single free-space chunk
-    nFree = 1;
-    
-    return 0;
+int initHeap(size_t size) {
+    HeapConfig config = { .size = size };
+    return initHeapWith(&config);
+}
+
+// initialise heap with the given options
+// the default heap is traced to the file named by $MYHEAP_TRACE, and sampled every $MYHEAP_SAMPLE bytes, unless the options say
+int initHeapWith(HeapConfig *config) {
+    if (defaultHeap != NULL) heapDestroy(defaultHeap);                      // re-initialising replaces the old default heap
+    HeapConfig traced = *config;
+    if (traced.trace == NULL) traced.trace = getenv("MYHEAP_TRACE");
+    if (traced.sampleEvery == 0 && getenv("MYHEAP_SAMPLE") != NULL) traced.sampleEvery = strtoul(getenv("MYHEAP_SAMPLE"),NULL,10);
+    defaultHeap = heapCreateWith(&traced);
+    defaultNumber++;
+    return (defaultHeap == NULL) ? -1 : 0;
 }
 
 // clean heap
 void freeHeap() {
-    free(heapMem);
-    free(freeList);
+    heapDestroy(defaultHeap);
+    defaultHeap = NULL;
+    defaultNumber++;
 }
 
 // allocate a chunk of memory
-void *myMalloc(int size) {
-    if (size < 1) return NULL;                                              // cannot malloc using zero or negative values
-    int remainder = size % 4;
-    if (remainder != 0) size = size + 4 - remainder;                        // round up to nearest multiple of 4 if not divisible by 4
-    int index = findSmallestChunk(size);                                    // search for smallest usable free-space chunk if any
-    if (index == -1) return NULL;                                           // cannot malloc if only inadequately sized chunks available
-    
-    Addr curr = heapMem;
-    Header *temp = (Header *)freeList[index];
-    if (temp->size <= (size + 8)) {                                         // allocate entire chunk if there would be no excess free space left over
-        uint oldSize = temp->size;                                          // get size of the chunk to be malloced
-        uint offset = (uint) heapOffset(freeList[index]);                   // get address offset of chunk from heapMem
-        curr = (Addr) ((char *)curr + offset);                              // add offset to get address of chunk
-        Header *newHeader = (Header *)curr;
-        newHeader->status = ALLOC;
-        newHeader->size = oldSize;
-        freeList[index] = NULL;
-        nFree--;
-        organiseNULL(index);                                                // move new NULL entry to back of array to retain sorted ascending address order
-    } else {                                                                // split large chunk into a allocated chunk for the request the rest as free space
-        uint freeSize = temp->size - (size + 8);                            // calculate free space excess from split
-        uint offset = (uint) heapOffset(freeList[index]);                   // get address offset of malloced lower chunk from heapMem
-        curr = (Addr) ((char *)curr + offset);                              // add offset to get address of malloced lower chunk
-        Header *newHeader = (Header *)curr;
-        newHeader->status = ALLOC;
-        newHeader->size = size + 8;
-        
-        Addr curr2 = (Addr) ((char *)curr + (size + 8));                    // add size of lower chunk to get address of upper chunk
-        Header *newHeader2 = (Header *)curr2;
-        newHeader2->status = FREE;
-        newHeader2->size = freeSize;
-        freeList[index] = curr2;                                            // replace old free space chunk with the new one
-        sortFreeList();                                                     // sort the freeList array to ensure ascending address order
-    }
-    
-    return curr + 8;
+void *myMalloc(size_t size) {
+    return heapMallocAt(defaultHeap,size,NULL);
+}
+
+// the same, charged to a call site when profiling
+void *myMallocAt(size_t size, const char *site) {
+    return heapMallocAt(defaultHeap,size,site);
 }
 
 // free a chunk of memory
 void myFree(void *block) {
-    block = (Addr) ((char *)block - 8);
-    Header *temp = (Header *)block;
-    if (block == NULL || temp->status != ALLOC) {
+    heapFree(defaultHeap,block);
+}
+
+// resize a chunk of memory
+void *myRealloc(void *block, size_t size) {
+    return heapReallocAt(defaultHeap,block,size,NULL);
+}
+
+void *myReallocAt(void *block, size_t size, const char *site) {
+    return heapReallocAt(defaultHeap,block,size,site);
+}
+
+// allocate a zeroed array of nelem elements of size bytes each
+void *myCalloc(size_t nelem, size_t size) {
+    return heapCallocAt(defaultHeap,nelem,size,NULL);
+}
+
+void *myCallocAt(size_t nelem, size_t size, const char *site) {
+    return heapCallocAt(defaultHeap,nelem,size,site);
+}
+
+// allocate a chunk of memory whose address is a multiple of alignment
+void *myMemalign(size_t alignment, size_t size) {
+    return heapMemalign(defaultHeap,alignment,size);
+}
+
+// allocate count chunks of size bytes at once
+int myMallocBatch(size_t size, int count, void **out) {
+    return heapMallocBatch(defaultHeap,size,count,out);
+}
+
+// free n chunks at once
+void myFreeBatch(void **ptrs, int n) {
+    heapFreeBatch(defaultHeap,ptrs,n);
+}
+
+// allocate a relocatable chunk of memory
+Handle myHandleAlloc(size_t size) {
+    return heapHandleAlloc(defaultHeap,size);
+}
+
+// address of a relocatable chunk, until the next myCompact
+void *myDeref(Handle handle) {
+    return heapDeref(defaultHeap,handle);
+}
+
+// free a relocatable chunk
+void myHandleFree(Handle handle) {
+    heapHandleFree(defaultHeap,handle);
+}
+
+// gather free space by moving relocatable chunks
+int myCompact(size_t budget) {
+    return heapCompact(defaultHeap,budget);
+}
+
+// number of the current default heap
+int myHeapNumber() {
+    return defaultNumber;
+}
+
+// convert pointer to offset in heapMem
+long heapOffset(void *p) {
+    return heapOffsetIn(defaultHeap,p);
+}
+
+// dump contents of heap (for testing/debugging)
+void dumpHeap() {
+    heapDump(defaultHeap);
+}
+
+// counters of the default heap
+void myHeapStats(HeapStats *stats) {
+    heapStats(defaultHeap,stats);
+}
+
+// print the allocation profile of the heap
+void dumpProfile(int inUse) {
+    heapProfileDump(defaultHeap,inUse);
+}
+
+// create a new heap of at least size bytes
+Heap heapCreate(size_t size) {
+    HeapConfig config = { .size = size };
+    return heapCreateWith(&config);
+}
+
+// create a new heap with the given options
+Heap heapCreateWith(HeapConfig *config) {
+    int align = (config->align == 0) ? 4 : config->align;
+    if (align < 4 || align > MIN_HEAP || (align & (align - 1)) != 0) return NULL;
+    if (config->policy < HEAP_BEST_FIT || config->policy > HEAP_NEXT_FIT) return NULL;
+    if (config->compact && config->concurrent) return NULL;                 // header words are shared by status and size, so threads would race on them
+    Size size = config->size;
+    if (size < MIN_HEAP) size = MIN_HEAP;                                   // set size to minimum heap size if less than it
+    Size maxSize = (config->maxSize > size) ? config->maxSize : size;
+    if (config->path != NULL) maxSize = size;                               // a heap file never grows, and reopening picks its headers by its size
+    if (maxSize >= WIDE_MIN && align < 8) align = 8;                        // wide headers hold 64-bit sizes, which want 8-byte alignment
+    Size remainder = size % align;
+    if (remainder != 0) size = size + align - remainder;                    // round up to nearest multiple of the alignment
+
+    if (maxSize > size) {                                                   // growable, round the ceiling like the size
+        remainder = maxSize % align;
+        if (remainder != 0) maxSize = maxSize - remainder;
+    } else {
+        maxSize = size;
+    }
+    if (config->compact && maxSize >= COMPACT_MAX) return NULL;
+
+    Heap h = malloc(sizeof(struct heap));
+    if (h == NULL) return NULL;
+    h->reserved = 0;
+    h->freed = 0;
+    h->file = NULL;
+    h->policy = config->policy;                                             // needed before any chunk goes into a bin
+    h->rover = 0;
+    h->highAbove = config->highAbove;
+    setLayout(h,maxSize >= WIDE_MIN,config->compact);
+    int reopened = 0;
+    if (config->path != NULL) {                                             // file-backed heaps keep a fixed size
+        reopened = mapFile(h,config->path,&size,&align);
+        if (reopened < 0) {
+            h->base = NULL;
+        } else if (h->compact && config->concurrent) {                      // a compact heap file cannot be shared by threads either
+            releaseSpace(h);
+            h->base = NULL;
+        }
+        maxSize = size;
+    } else if (config->mapped || maxSize > size) {                                 // reserve the whole range now so the heap stays one contiguous block
+        h->reserved = maxSize + align;
+        h->base = mmap(NULL,h->reserved,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+        if (h->base == MAP_FAILED) h->base = NULL;
+#ifdef MADV_HUGEPAGE
+        if (h->base != NULL && config->hugePages) madvise(h->base,h->reserved,MADV_HUGEPAGE);
+#endif
+    } else {
+        h->base = calloc(1,size + align);                                   // room to slide mem along to an aligned payload
+    }
+    if (h->base == NULL) {
+        free(h);
+        return NULL;
+    }
+    if (h->file == NULL) {
+        uintptr_t firstPayload = (uintptr_t) h->base + h->hdr;
+        h->mem = (char *)h->base + (align - firstPayload % align) % align;  // first chunk's payload is aligned, chunk sizes keep the rest aligned
+    }
+    h->size = 0;
+    h->maxSize = maxSize;
+    h->growBy = config->growBy;
+    h->align = align;
+    if (h->file == NULL && h->reserved != 0) {                              // a new file, fresh mapping or big calloc reads as zero, a page at a time
+        if (!commitSpace(h,size)) {                                         // as it is touched, so nothing here is proportional to size
+            munmap(h->base,h->reserved);
+            free(h);
+            return NULL;
+        }
+    }
+    h->size = size;
+
+    h->root = NONE;
+    h->mallocs = h->frees = h->splits = h->merges = 0;
+    if (reopened) {
+        loadFile(h);                                                        // chunks and free list are where the last user left them
+    } else {
+        for (int i = 0; i < NBINS; i++) h->bins[i] = NONE;                  // start with every bin empty
+        memset(h->binMap,0,sizeof(h->binMap));
+        h->nFree = 0;
+        h->freeBytes = 0;
+        memset(h->freeBySize,0,sizeof(h->freeBySize));
+        h->largest = 0;
+        h->nChunks = 1;
+        h->touched = 0;
+        h->lastFree = 0;
+        markFree(h,0,size);                                                 // initialise region to be a single large free-space chunk
+        addFree(h,0);
+    }
+
+    for (int i = 0; i < NQUICK; i++) {
+        h->quick[i] = NONE;
+        h->quickCount[i] = 0;
+    }
+    h->quickBytes = 0;
+
+    h->handles = NULL;
+    h->spare = NULL;
+    h->nHandles = h->maxHandles = h->nSpare = 0;
+    h->compactAt = 0;
+
+    h->mapAbove = config->mapAbove;
+    h->maps = NULL;
+    h->nMaps = h->maxMaps = 0;
+    h->mappedBytes = 0;
+
+    h->sampleEvery = config->sampleEvery;
+    h->sampleLeft = config->sampleEvery;
+    h->sites = NULL;
+    h->nSites = h->maxSites = 0;
+    h->samples = NULL;
+    h->nSamples = h->maxSamples = 0;
+
+    h->concurrent = config->concurrent;
+    h->caches = NULL;
+    h->pending = NONE;
+    if (h->concurrent) {
+        if (pthread_key_create(&h->cacheKey,cacheExit) != 0) {
+            releaseSpace(h);
+            free(h);
+            return NULL;
+        }
+        pthread_mutex_init(&h->lock,NULL);
+    }
+
+    h->trace = NULL;
+    if (config->trace != NULL) {
+        h->trace = fopen(config->trace,"wb");
+        if (h->trace != NULL) {
+            TraceRecord rec = { .op = TRACE_INIT, .size = h->size, .offset = h->mapAbove ? h->mapAbove : TRACE_NONE, .old = h->align };
+            fwrite(&rec,sizeof(rec),1,h->trace);
+            TraceRecord settings[] = {                                      // enough to replay the trace on a heap that behaves the same
+                { .op = TRACE_CONFIG, .size = h->maxSize,       .old = TRACE_SET_MAX_SIZE },
+                { .op = TRACE_CONFIG, .size = h->growBy,        .old = TRACE_SET_GROW_BY },
+                { .op = TRACE_CONFIG, .size = h->policy,        .old = TRACE_SET_POLICY },
+                { .op = TRACE_CONFIG, .size = h->highAbove,     .old = TRACE_SET_HIGH_ABOVE },
+                { .op = TRACE_CONFIG, .size = h->compact,       .old = TRACE_SET_COMPACT },
+                { .op = TRACE_CONFIG, .size = h->reserved != 0, .old = TRACE_SET_MAPPED },
+                { .op = TRACE_CONFIG, .size = h->concurrent,    .old = TRACE_SET_CONCURRENT },
+            };
+            fwrite(settings,sizeof(TraceRecord),sizeof(settings)/sizeof(settings[0]),h->trace);
+        }
+    }
+
+    return h;
+}
+
+// release a heap and everything allocated in it, a file-backed heap is saved and closed instead
+// a concurrent heap must no longer be in use by any other thread
+void heapDestroy(Heap h) {
+    if (h == NULL) return;
+    if (h->concurrent) {
+        pthread_key_delete(h->cacheKey);                                    // threads still running will not flush into a dead heap
+        while (h->caches != NULL) {
+            ThreadCache *next = h->caches->next;
+            if (h->file != NULL) flushCache(h->caches);                     // cached chunks must not stay allocated in the file
+            free(h->caches);
+            h->caches = next;
+        }
+        if (h->file != NULL) drainPending(h);
+        pthread_mutex_destroy(&h->lock);
+    }
+    if (h->file != NULL) {
+        consolidate(h);                                                     // quick chunks must not stay allocated in the file
+        saveFile(h);
+    }
+    if (h->trace != NULL) fclose(h->trace);
+    free(h->handles);
+    free(h->spare);
+    for (int i = 0; i < h->nMaps; i++) munmap(h->maps[i].block,h->maps[i].size);
+    free(h->maps);
+    free(h->sites);
+    free(h->samples);
+    releaseSpace(h);
+    free(h);
+}
+
+// allocate a chunk of memory from heap h
+void *heapMalloc(Heap h, size_t size) {
+    return heapMallocAt(h,size,NULL);
+}
+
+// the same, charged to a call site when profiling
+void *heapMallocAt(Heap h, size_t size, const char *site) {
+    void *block = mallocBlock(h,size);
+    if (h != NULL && h->trace != NULL) traceCall(h,TRACE_MALLOC,size,block,0);
+    if (h != NULL && h->sampleEvery != 0) sampleAlloc(h,block,size,site);
+    return block;
+}
+
+// free a chunk of memory in heap h
+void heapFree(Heap h, void *block) {
+    if (h != NULL && __atomic_load_n(&h->nSamples,__ATOMIC_RELAXED) != 0) sampleFree(h,block); // before the block can be handed out again
+    freeBlock(h,block);
+    if (h->trace != NULL) traceCall(h,TRACE_FREE,0,block,0);
+}
+
+// resize a chunk of memory in heap h, in place if possible
+// behaves like myMalloc for a NULL block and like myFree for size 0
+void *heapRealloc(Heap h, void *block, size_t size) {
+    return heapReallocAt(h,block,size,NULL);
+}
+
+// the same, charged to a call site when profiling, a sampled block resized counts as freed and allocated again
+void *heapReallocAt(Heap h, void *block, size_t size, const char *site) {
+    Size old = (h == NULL) ? TRACE_NONE : traceOffset(h,block);
+    int sampled = (h != NULL && block != NULL && __atomic_load_n(&h->nSamples,__ATOMIC_RELAXED) != 0);
+    if (sampled) sampleFree(h,block);
+    void *moved = reallocBlock(h,block,size);
+    if (h != NULL && h->trace != NULL) traceCall(h,TRACE_REALLOC,size,moved,old);
+    if (h != NULL && h->sampleEvery != 0) sampleAlloc(h,(moved == NULL && size > 0) ? NULL : moved,size,site);
+    return moved;
+}
+
+// allocate a zeroed array of nelem elements of size bytes each in heap h
+void *heapCalloc(Heap h, size_t nelem, size_t size) {
+    return heapCallocAt(h,nelem,size,NULL);
+}
+
+void *heapCallocAt(Heap h, size_t nelem, size_t size, const char *site) {
+    void *block = callocBlock(h,nelem,size);
+    if (h != NULL && h->trace != NULL) traceCall(h,TRACE_CALLOC,nelem*size,block,0);
+    if (h != NULL && h->sampleEvery != 0) sampleAlloc(h,block,nelem*size,site);
+    return block;
+}
+
+// allocate a chunk of memory from heap h whose address is a multiple of alignment
+void *heapMemalign(Heap h, size_t alignment, size_t size) {
+    void *block = memalignBlock(h,alignment,size);
+    if (h != NULL && h->trace != NULL) traceCall(h,TRACE_MEMALIGN,size,block,alignment);
+    if (h != NULL && h->sampleEvery != 0) sampleAlloc(h,block,size,NULL);
+    return block;
+}
+
+// allocate count chunks of size bytes from heap h into out, carving them from as few free chunks as possible
+// returns how many were allocated, fewer than count only if the heap is full
+int heapMallocBatch(Heap h, size_t size, int count, void **out) {
+    int done = mallocBatch(h,size,count,out);
+    if (h != NULL && h->trace != NULL)
+        for (int i = 0; i < done; i++) traceCall(h,TRACE_MALLOC,size,out[i],0);
+    if (h != NULL && h->sampleEvery != 0)
+        for (int i = 0; i < done; i++) sampleAlloc(h,out[i],size,NULL);
+    return done;
+}
+
+// free n chunks of heap h at once, coalescing neighbours among them in one pass
+// ptrs is sorted into address order
+void heapFreeBatch(Heap h, void **ptrs, int n) {
+    if (__atomic_load_n(&h->nSamples,__ATOMIC_RELAXED) != 0)
+        for (int i = 0; i < n; i++) sampleFree(h,ptrs[i]);
+    freeBatch(h,ptrs,n);
+    if (h->trace != NULL)
+        for (int i = 0; i < n; i++) traceCall(h,TRACE_FREE,0,ptrs[i],0);
+}
+
+// append a record of one call to the heap's trace
+static void traceCall(Heap h, uint op, Size size, void *block, Size old) {
+    TraceRecord rec = { .op = op, .size = size, .offset = traceOffset(h,block), .old = old };
+    fwrite(&rec,sizeof(rec),1,h->trace);                                    // stdio locks the stream, so threads do not interleave records
+}
+
+// count an allocation of size bytes towards the next sample, and record it against site if it is the one
+// a small block sampled stands for the sampleEvery bytes allocated since the last, a big one for itself
+static void sampleAlloc(Heap h, void *block, Size size, const char *site) {
+    if (block == NULL) return;
+    long left;
+    if (h->concurrent)
+        left = __atomic_sub_fetch(&h->sampleLeft,(long) size,__ATOMIC_RELAXED);
+    else
+        left = h->sampleLeft -= size;
+    if (left > 0) return;
+
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    __atomic_store_n(&h->sampleLeft,(long) h->sampleEvery,__ATOMIC_RELAXED);
+    Size weight = (size > h->sampleEvery) ? size : h->sampleEvery;
+    int i = siteOf(h,(site == NULL) ? "?" : site);
+    Sample *slot = (i < 0 || !growSamples(h)) ? NULL : slotOf(h,block);
+    if (slot != NULL) {
+        if (slot->block == NULL) __atomic_store_n(&h->nSamples,h->nSamples + 1,__ATOMIC_RELAXED);
+        *slot = (Sample) { block, i, weight };
+        h->sites[i].allocs++;
+        h->sites[i].bytes += weight;
+        h->sites[i].liveAllocs++;
+        h->sites[i].liveBytes += weight;
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+}
+
+// take a block that is being freed off the profile, if it was sampled
+static void sampleFree(Heap h, void *block) {
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    int mask = h->maxSamples - 1;
+    int i = (h->nSamples == 0) ? -1 : slotOf(h,block) - h->samples;
+    if (i >= 0 && h->samples[i].block == block) {
+        Site *site = &h->sites[h->samples[i].site];
+        site->liveAllocs--;
+        site->liveBytes -= h->samples[i].weight;
+        h->samples[i].block = NULL;
+        __atomic_store_n(&h->nSamples,h->nSamples - 1,__ATOMIC_RELAXED);
+        for (int j = (i + 1) & mask; h->samples[j].block != NULL; j = (j + 1) & mask) {
+            Sample moving = h->samples[j];                                  // put back each sample that probed past the hole
+            h->samples[j].block = NULL;
+            *slotOf(h,moving.block) = moving;
+        }
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+}
+
+// index of the call site called name, added if it is new, or -1 if there is no memory for it
+// a site is the same whether or not its string was merged with others like it
+static int siteOf(Heap h, const char *name) {
+    for (int i = 0; i < h->nSites; i++)
+        if (h->sites[i].name == name || strcmp(h->sites[i].name,name) == 0) return i;
+    if (h->nSites == h->maxSites) {
+        int max = (h->maxSites == 0) ? 16 : 2*h->maxSites;
+        Site *sites = realloc(h->sites,max*sizeof(Site));
+        if (sites == NULL) return -1;
+        h->sites = sites;
+        h->maxSites = max;
+    }
+    h->sites[h->nSites] = (Site) { .name = name };
+    return h->nSites++;
+}
+
+// make room in the table of samples for one more, doubling it before it is half full, returns 0 if it cannot
+static int growSamples(Heap h) {
+    if (2*(h->nSamples + 1) <= h->maxSamples) return 1;
+    int max = (h->maxSamples == 0) ? 64 : 2*h->maxSamples;
+    Sample *samples = calloc(max,sizeof(Sample));
+    if (samples == NULL) return 0;
+    Sample *old = h->samples;
+    int oldMax = h->maxSamples;
+    h->samples = samples;
+    h->maxSamples = max;
+    for (int i = 0; i < oldMax; i++)
+        if (old[i].block != NULL) *slotOf(h,old[i].block) = old[i];
+    free(old);
+    return 1;
+}
+
+// slot holding block in the table of samples, or the empty slot where it would go
+static Sample *slotOf(Heap h, Addr block) {
+    int mask = h->maxSamples - 1;
+    int i = ((uintptr_t) block * 0x9E3779B97F4A7C15u >> 32) & mask;
+    while (h->samples[i].block != NULL && h->samples[i].block != block) i = (i + 1) & mask;
+    return &h->samples[i];
+}
+
+// print the allocation profile of heap h as collapsed stacks, a "site bytes" line for each call site
+// the bytes still in use if inUse, else all those allocated since the heap was created, both estimated from the samples
+void heapProfileDump(Heap h, int inUse) {
+    if (h == NULL) return;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    for (int i = 0; i < h->nSites; i++) {
+        long bytes = inUse ? h->sites[i].liveBytes : h->sites[i].bytes;
+        if (bytes > 0) printf("%s %ld\n",h->sites[i].name,bytes);
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+}
+
+// how a trace names a block: its offset, or TRACE_MAPPED and its address if it is outside the heap
+// still right for a block just freed, even one whose mapping has gone
+static Size traceOffset(Heap h, void *block) {
+    if (block == NULL) return TRACE_NONE;
+    if (block >= h->mem && (char *)block < chunkAt(h,h->size)) return (char *)block - (char *)h->mem;
+    return TRACE_MAPPED | (uintptr_t) block;
+}
+
+// allocate a chunk of memory from heap h
+static void *mallocBlock(Heap h, Size size) {
+    if (h == NULL || size < 1) return NULL;                                 // cannot malloc zero bytes
+    if (h->mapAbove != 0 && size >= h->mapAbove) return mapBlock(h,size);
+    if (size > h->maxSize) return NULL;                                     // or more than the heap could ever hold
+    size = roundSize(h,size);
+    if (h->concurrent) return cacheMalloc(h,size);
+    Size chunk = size + h->hdr;
+    Addr block;
+    if (chunk < QUICK_MAX && h->quick[chunk/4] != NONE)
+        block = quickMalloc(h,chunk/4);                                     // the last chunk of this size freed, no search or split
+    else
+        block = allocChunk(h,size);
+    if (block != NULL) COUNT(h->mallocs,1);
+    return block;
+}
+
+// free a chunk of memory in heap h
+static void freeBlock(Heap h, void *block) {
+    if (h != NULL && h->mapAbove != 0 && heapOffsetIn(h,block) == -2) {
+        unmapBlock(h,block);                                                // goes straight back to the system
+        return;
+    }
+    if (block != NULL && h != NULL) block = (Addr) ((char *)block - h->hdr);
+    if (heapOffsetIn(h,block) < 0 || statusOf(h,heapOffsetIn(h,block)) != ALLOC) {
         fprintf(stderr,"Attempt to free unallocated chunk\n");              // return error if block is an allocated chunk or if the address is not the start of a data block
         exit(1);
     }
-    
-    temp->status = FREE;                                                    // release allocated chunk
-    freeList[nFree] = block;                                                // place new free chunk into freeList array
-    nFree++;
-    sortFreeList();                                                         // sort the freeList array to ensure ascending address order
-    int index = findAddressInFreeList(block);
-    
-    if (nFree != 1) {
-        if (index == 0) {
-            adjacentRight(index,block);
-        } else if (index == (nFree - 1)) {
-            adjacentLeft(index,block);
+
+    Size offset = (Size) heapOffsetIn(h,block);
+    Size size = chunkSize(h,offset);
+    if (h->concurrent) {
+        cacheFree(h,offset);
+    } else if (size < QUICK_MAX && h->quickCount[size/4] < QUICK_DEPTH
+               && !(sizeWord(h,offset) & PREV_FREE)                         // a chunk with a free neighbour is merged now,
+               && (offset + size >= h->size || statusOf(h,offset + size) != FREE)) {
+        quickFree(h,offset,size);                                           // others wait on a quick list to be reused as they are
+        COUNT(h->frees,1);
+    } else {
+        releaseChunk(h,offset);
+        COUNT(h->frees,1);
+    }
+}
+
+// allocate count chunks of size bytes, each free chunk used is cut into as many as it holds
+static int mallocBatch(Heap h, Size size, int count, void **out) {
+    if (h == NULL || size < 1 || count < 1) return 0;
+    if (h->mapAbove != 0 && size >= h->mapAbove) {                          // each gets a mapping, there is nothing to carve
+        int done = 0;
+        while (done < count && (out[done] = mapBlock(h,size)) != NULL) done++;
+        return done;
+    }
+    if (size > h->maxSize) return 0;
+    size = roundSize(h,size);
+    Size each = size + h->hdr;
+    int done = 0;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    while (done < count) {
+        Size n = count - done;
+        if (n > h->maxSize / each) n = h->maxSize / each;
+        Size offset = findFit(h,n*each - h->hdr);                           // one chunk for the lot, if there is one
+        if (offset == NONE) {
+            Size largest = largestChunk(h);                                 // otherwise as many as the biggest chunk holds
+            if (largest != NONE && chunkSize(h,largest) >= each)
+                offset = largest;
+            else
+                offset = findChunk(h,size);                                 // or grow the heap for at least one
+        }
+        if (offset == NONE) break;
+        removeFree(h,offset);
+        Size have = chunkSize(h,offset);
+        if (n > have/each) n = have/each;
+        for (Size i = 0; i < n - 1; i++) {                                  // a free chunk never follows another, so no PREV_FREE flags
+            setStatus(h,offset,ALLOC);
+            setSizeWord(h,offset,each);
+            out[done++] = chunkAt(h,offset) + h->hdr;
+            offset += each;
+            have -= each;
+        }
+        setSizeWord(h,offset,have);
+        takeChunk(h,offset,have,each);                                      // the last one takes care of the remainder
+        out[done++] = chunkAt(h,offset) + h->hdr;
+        COUNT(h->splits,n - 1);
+        COUNT(h->nChunks,n - 1);
+    }
+    COUNT(h->mallocs,done);
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return done;
+}
+
+static int byAddress(const void *a, const void *b) {
+    Addr x = *(Addr *)a, y = *(Addr *)b;
+    return (x > y) - (x < y);
+}
+
+// free n chunks, sorted first so each run of neighbouring chunks goes back as one
+static void freeBatch(Heap h, void **ptrs, int n) {
+    for (int i = 0; i < n; i++) {
+        if (h->mapAbove != 0 && heapOffsetIn(h,ptrs[i]) == -2) continue;
+        Addr temp = (ptrs[i] == NULL) ? NULL : (char *)ptrs[i] - h->hdr;
+        if (heapOffsetIn(h,temp) < 0 || statusOf(h,heapOffsetIn(h,temp)) != ALLOC) {
+            fprintf(stderr,"Attempt to free unallocated chunk\n");
+            exit(1);
+        }
+    }
+    qsort(ptrs,n,sizeof(void *),byAddress);
+    for (int i = 1; i < n; i++) {
+        if (ptrs[i] == ptrs[i-1]) {                                         // the same chunk twice
+            fprintf(stderr,"Attempt to free unallocated chunk\n");
+            exit(1);
+        }
+    }
+
+    int lo = 0, hi = n;                                                     // mapped blocks sort below or above every chunk of the heap
+    while (lo < hi && heapOffsetIn(h,ptrs[lo]) < 0) unmapBlock(h,ptrs[lo++]);
+    while (hi > lo && heapOffsetIn(h,ptrs[hi-1]) < 0) unmapBlock(h,ptrs[--hi]);
+
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    for (int i = lo; i < hi; ) {
+        Size first = (Size) heapOffsetIn(h,ptrs[i]) - h->hdr;
+        Size end = first + chunkSize(h,first);
+        for (i++; i < hi && (Size) heapOffsetIn(h,ptrs[i]) - h->hdr == end; i++) { // absorb the next chunk if it is also being freed
+            forgetHeader(h,end,first);
+            end += chunkSize(h,end);
+            COUNT(h->merges,1);
+            COUNT(h->nChunks,-1);
+        }
+        setSizeWord(h,first,(end - first) | (sizeWord(h,first) & PREV_FREE));
+        releaseChunk(h,first);
+    }
+    if (h->concurrent)
+        __atomic_fetch_add(&h->frees,hi - lo,__ATOMIC_RELAXED);
+    else
+        COUNT(h->frees,hi - lo);
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+}
+
+// resize a chunk of memory in heap h, in place if possible
+static void *reallocBlock(Heap h, void *block, Size size) {
+    if (block == NULL) return mallocBlock(h,size);
+    if (size < 1) {
+        freeBlock(h,block);
+        return NULL;
+    }
+    if (h != NULL && h->mapAbove != 0 && heapOffsetIn(h,block) == -2) return remapBlock(h,block,size);
+    Addr temp = (h == NULL) ? NULL : (char *)block - h->hdr;
+    if (heapOffsetIn(h,temp) < 0 || statusOf(h,heapOffsetIn(h,temp)) != ALLOC) {
+        fprintf(stderr,"Attempt to realloc unallocated chunk\n");
+        exit(1);
+    }
+
+    Size offset = (Size) heapOffsetIn(h,temp);
+    int done = 0;
+    if (h->mapAbove == 0 || size < h->mapAbove) {                           // otherwise it moves out to a mapping of its own
+        if (size > h->maxSize) return NULL;                                 // could never fit, the block stays as it is
+        if (h->concurrent) pthread_mutex_lock(&h->lock);
+        done = resizeChunk(h,offset,roundSize(h,size));
+        if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    }
+    if (done) return block;
+
+    void *moved = mallocBlock(h,size);                                      // no room where it is, so move it
+    if (moved == NULL) return NULL;
+    Size oldSize = chunkSize(h,offset) - h->hdr;
+    memcpy(moved,block,(oldSize < size) ? oldSize : size);
+    freeBlock(h,block);
+    return moved;
+}
+
+// allocate a zeroed array of nelem elements of size bytes each in heap h
+// memory that has not been used since the heap was created is already zero
+static void *callocBlock(Heap h, Size nelem, Size size) {
+    if (h != NULL && h->mapAbove != 0 && nelem > 0 && size > 0 && nelem <= NONE/size && nelem*size >= h->mapAbove)
+        return mapBlock(h,nelem*size);                                      // fresh pages are zero already
+    if (h == NULL || nelem < 1 || size < 1 || nelem > h->maxSize/size) return NULL;
+    Size before = h->concurrent ? 0 : h->touched;                           // high-water mark before this allocation
+    char *block = mallocBlock(h,nelem*size);
+    if (block == NULL) return NULL;
+
+    Size offset = (Size) heapOffsetIn(h,block) - h->hdr;
+    Size end = offset + chunkSize(h,offset);
+    Size dirty = end;                                                       // bytes below here may hold old data
+    if (!h->concurrent && before + h->node < end) {                         // carved from the untouched top of the heap
+        dirty = before + h->node;                                           // the top free chunk's tags may sit just above the mark
+        if (dirty < offset + h->node) dirty = offset + h->node;
+        memset(chunkAt(h,end) - h->tag,0,h->tag);                           // and its footer may be at our end
+    }
+    memset(block,0,dirty - (offset + h->hdr));
+    return block;
+}
+
+// allocate a chunk of memory from heap h whose address is a multiple of alignment
+// any space skipped to reach the aligned address goes back into the bins
+static void *memalignBlock(Heap h, Size alignment, Size size) {
+    if (h == NULL || size < 1 || alignment < 1 || (alignment & (alignment - 1)) != 0) return NULL;
+    if (alignment <= (Size) h->align) return mallocBlock(h,size);           // every chunk is aligned this well anyway
+    if (h->mapAbove != 0 && size >= h->mapAbove && alignment <= (Size) sysconf(_SC_PAGESIZE))
+        return mapBlock(h,size);                                            // and so is every mapping
+    if (size > h->maxSize || alignment > h->maxSize) return NULL;
+    size = roundSize(h,size);
+    if (size + alignment + h->minFree > h->maxSize) return NULL;
+
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    void *block = NULL;
+    Size offset = findChunk(h,size + alignment + h->minFree);               // room for the worst-case lead-in as well
+    if (offset != NONE) {
+        removeFree(h,offset);
+        Size have = chunkSize(h,offset);
+        uintptr_t payload = (uintptr_t) chunkAt(h,offset) + h->hdr;
+        Size lead = (alignment - payload % alignment) % alignment;
+        while (lead != 0 && lead < h->minFree) lead += alignment;           // lead-in must be big enough to be a free chunk
+        setStatus(h,offset + lead,ALLOC);
+        setSizeWord(h,offset + lead,have - lead);
+        if (lead != 0) {
+            markFree(h,offset,lead);                                        // also flags the aligned chunk as following a free one
+            addFree(h,offset);
+            COUNT(h->splits,1);
+            COUNT(h->nChunks,1);
+        }
+        takeChunk(h,offset + lead,have - lead,size + h->hdr);
+        block = chunkAt(h,offset + lead) + h->hdr;
+        COUNT(h->mallocs,1);
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return block;
+}
+
+// round a request up to the payload size of the chunk that will hold it
+static Size roundSize(Heap h, Size size) {
+    if (size + h->hdr < h->minFree) size = h->minFree - h->hdr;             // chunk must be able to hold its index links and footer once it is freed
+    Size remainder = (size + h->hdr) % h->align;
+    if (remainder != 0) size = size + h->align - remainder;                 // round chunk up to a multiple of the heap's alignment
+    return size;
+}
+
+// take a chunk with room for size bytes (already rounded) out of the bins
+static void *allocChunk(Heap h, Size size) {
+    Size offset = findChunk(h,size);                                        // search for smallest usable free-space chunk if any
+    if (offset == NONE) return NULL;                                        // cannot malloc if only inadequately sized chunks available
+
+    removeFree(h,offset);                                                   // chunk is no longer free, take it out of its bin
+    Size have = chunkSize(h,offset);
+    Size want = size + h->hdr;
+    if (h->highAbove != 0 && size >= h->highAbove && have - want >= h->minChunk)
+        offset = takeChunkHigh(h,offset,have,want);                         // big ones from the top, away from the small ones at the bottom
+    else
+        takeChunk(h,offset,have,want);
+    return chunkAt(h,offset) + h->hdr;
+}
+
+// find a free chunk for size bytes under the heap's policy, extending a growable heap if none is big enough
+// the quick lists are consolidated first, in case their chunks merge into one that fits
+static Size findChunk(Heap h, Size size) {
+    Size offset = findFit(h,size);
+    if (offset == NONE && h->quickBytes != 0) {
+        consolidate(h);
+        offset = findFit(h,size);
+    }
+    if (offset == NONE && growHeap(h,size + h->hdr)) offset = findFit(h,size);
+    return offset;
+}
+
+// take the chunk at the head of quick list cls
+static void *quickMalloc(Heap h, int cls) {
+    Size offset = h->quick[cls];
+    h->quick[cls] = linkOf(h,offset);
+    COUNT(h->quickCount[cls],-1);
+    COUNT(h->quickBytes,-(cls*4));
+    setStatus(h,offset,ALLOC);
+    return chunkAt(h,offset) + h->hdr;
+}
+
+// park a small chunk on the quick list for its size
+static void quickFree(Heap h, Size offset, Size size) {
+    int cls = size/4;
+    setStatus(h,offset,CACHED);
+    setLink(h,offset,h->quick[cls]);
+    h->quick[cls] = offset;
+    COUNT(h->quickCount[cls],1);
+    COUNT(h->quickBytes,size);
+}
+
+// return every chunk on the quick lists to the bins, merging each with its free neighbours
+static void consolidate(Heap h) {
+    if (h->quickBytes == 0) return;
+    for (int i = 0; i < NQUICK; i++) {
+        while (h->quick[i] != NONE) {
+            Size offset = h->quick[i];
+            h->quick[i] = linkOf(h,offset);
+            releaseChunk(h,offset);
+        }
+        STORE(h->quickCount[i],0);
+    }
+    STORE(h->quickBytes,0);
+}
+
+// extend a growable heap by at least need bytes, merging the new space into a free chunk at the top
+// returns 0 if the heap is fixed or would pass its ceiling
+static int growHeap(Heap h, Size need) {
+    if (h->reserved == 0) return 0;
+    Size oldSize = h->size;
+    Size step = (h->growBy != 0) ? h->growBy : oldSize;                     // default policy doubles the heap
+    if (step < need) step = need;
+    Size newSize = (step > h->maxSize - oldSize) ? h->maxSize : oldSize + step;
+    newSize -= newSize % h->align;
+    if (newSize - oldSize < need || !commitSpace(h,newSize)) return 0;
+
+    setStatus(h,oldSize,ALLOC);                                             // wrap the new space as an allocated chunk and free it
+    setSizeWord(h,oldSize,(newSize - oldSize) | (h->lastFree ? PREV_FREE : 0));
+    COUNT(h->nChunks,1);
+    STORE(h->size,newSize);
+    int merged = h->lastFree;
+    releaseChunk(h,oldSize);
+    if (merged)                                                             // old footer and the new header are now inside a free chunk
+        memset(chunkAt(h,oldSize) - h->tag,0,h->tag + h->hdr);
+    return 1;
+}
+
+// make the first size bytes of a growable heap's reservation usable
+static int commitSpace(Heap h, Size size) {
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t from = ((uintptr_t) h->mem + h->size) / page * page;         // pages below the current size are already usable
+    uintptr_t to = ((uintptr_t) h->mem + size + page - 1) / page * page;
+    if (to <= from) return 1;
+    return mprotect((void *) from,to - from,PROT_READ|PROT_WRITE) == 0;
+}
+
+// give a heap's memory back to the system
+static void releaseSpace(Heap h) {
+    if (h->reserved != 0)
+        munmap(h->base,h->reserved);
+    else
+        free(h->base);
+    if (h->file != NULL) close(h->fd);                                      // which unlocks it for the next user
+}
+
+// choose between the 8-byte Header of a heap under 4GiB, the 16-byte WideHeader and a compact heap's one word
+static void setLayout(Heap h, int wide, int compact) {
+    h->wide = wide;
+    h->compact = compact;
+    h->hdr = wide ? sizeof(WideHeader) : compact ? sizeof(uint) : sizeof(Header);
+    h->tag = wide ? sizeof(Size) : sizeof(uint);
+    h->node = wide ? sizeof(WideFreeChunk) : compact ? sizeof(CompactFreeChunk) : sizeof(FreeChunk);
+    h->minFree = h->node + h->tag;
+    h->minChunk = h->minFree + MIN_SPARE;
+}
+
+// map the heap file at path into h, creating it with room for size bytes if it is empty
+// returns 1 if it already held a heap, 0 if a new one was made, -1 on failure or if another handle has it open
+static int mapFile(Heap h, const char *path, Size *size, int *align) {
+    int fd = open(path,O_RDWR|O_CREAT,0644);
+    if (fd < 0) return -1;
+    if (flock(fd,LOCK_EX|LOCK_NB) != 0) {                                   // two handles would each index the free chunks their own way
+        close(fd);
+        return -1;
+    }
+    struct stat st;
+    HeapFile old;
+    int reopened = 0;
+    if (fstat(fd,&st) == 0 && st.st_size != 0) {                            // not new, it must hold a heap
+        if (pread(fd,&old,sizeof(old),0) != sizeof(old) || old.magic != HEAP_MAGIC) {
+            close(fd);
+            return -1;
+        }
+        *size = old.size;
+        *align = old.align;
+        setLayout(h,old.size >= WIDE_MIN,old.compact);
+        reopened = 1;
+    }
+    size_t space = (sizeof(HeapFile) + h->hdr + *align - 1) / *align * *align - h->hdr;  // metadata, then padding so the first payload is aligned
+    h->reserved = space + *size;
+    if ((reopened && (size_t) st.st_size < h->reserved) || (!reopened && ftruncate(fd,h->reserved) != 0)) {
+        close(fd);
+        return -1;
+    }
+    h->base = mmap(NULL,h->reserved,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    if (h->base == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    h->fd = fd;
+    h->file = h->base;
+    h->mem = (char *)h->base + space;
+    h->file->magic = HEAP_MAGIC;
+    h->file->size = *size;
+    h->file->align = *align;
+    h->file->compact = h->compact;
+    return reopened;
+}
+
+// pick up the free list of a reopened heap file
+static void loadFile(Heap h) {
+    HeapFile *f = h->file;
+    if (f->clean && f->byAddress == (h->policy != HEAP_BEST_FIT)) {
+        memcpy(h->bins,f->bins,sizeof(h->bins));
+        memcpy(h->binMap,f->binMap,sizeof(h->binMap));
+        memset(h->freeBySize,0,sizeof(h->freeBySize));
+        for (int bin = 0; bin < NBINS; bin++) countTree(h,h->bins[bin]);
+        h->nFree = f->nFree;
+        h->freeBytes = f->freeBytes;
+        h->nChunks = f->nChunks;
+        Size top = largestChunk(h);
+        h->largest = (top == NONE) ? 0 : chunkSize(h,top);
+        h->touched = f->touched;
+        h->lastFree = f->lastFree;
+    } else {
+        rebuildBins(h);                                                     // last user did not close it or kept its bins in another order
+    }
+    h->root = f->root;
+    f->clean = 0;                                                           // until this user closes it
+}
+
+// add the free chunks in the tree rooted at root to the size histogram
+static void countTree(Heap h, Size root) {
+    if (root == NONE) return;
+    COUNT(h->freeBySize[topBit(chunkSize(h,root))],1);
+    countTree(h,leftOf(h,root));
+    countTree(h,rightOf(h,root));
+}
+
+// save the free list of a heap file so the next user can reopen it
+static void saveFile(Heap h) {
+    HeapFile *f = h->file;
+    memcpy(f->bins,h->bins,sizeof(h->bins));
+    memcpy(f->binMap,h->binMap,sizeof(h->binMap));
+    f->nFree = h->nFree;
+    f->freeBytes = h->freeBytes;
+    f->nChunks = h->nChunks;
+    f->touched = h->touched;
+    f->lastFree = h->lastFree;
+    f->byAddress = (h->policy != HEAP_BEST_FIT);
+    f->root = h->root;
+    f->clean = 1;
+    msync(h->base,h->reserved,MS_SYNC);
+}
+
+// rebuild the bins by walking every chunk, merging neighbouring free ones
+// chunks that were sitting in thread caches are freed
+static void rebuildBins(Heap h) {
+    for (int i = 0; i < NBINS; i++) h->bins[i] = NONE;
+    memset(h->binMap,0,sizeof(h->binMap));
+    h->nFree = 0;
+    h->freeBytes = 0;
+    memset(h->freeBySize,0,sizeof(h->freeBySize));
+    h->largest = 0;
+    h->nChunks = 0;
+    h->touched = h->size;                                                   // no telling what is still zero
+    h->lastFree = 0;
+    Size offset = 0;
+    Size prev = NONE;                                                       // free chunk just below offset, or NONE
+    while (offset < h->size) {
+        uint status = statusOf(h,offset);
+        Size size = chunkSize(h,offset);
+        if (size < h->minFree || size > h->size - offset || (status != ALLOC && status != FREE && status != CACHED)) {
+            fprintf(stderr,"Corrupted heap %08x\n",*(uint *)chunkAt(h,offset));
+            exit(1);
+        }
+        COUNT(h->nChunks,1);
+        if (status == ALLOC) {
+            setSizeWord(h,offset,size | ((prev != NONE) ? PREV_FREE : 0));
+            prev = NONE;
+        } else if (prev != NONE) {                                          // grow the free chunk below over this one
+            removeFree(h,prev);
+            markFree(h,prev,offset + size - prev);
+            addFree(h,prev);
+            COUNT(h->nChunks,-1);
         } else {
-            adjacentRight(index,block);
-            adjacentLeft(index,block);
+            markFree(h,offset,size);
+            addFree(h,offset);
+            prev = offset;
         }
+        offset += size;
     }
+    h->lastFree = (prev != NONE);
 }
 
-// convert pointer to offset in heapMem
-int  heapOffset(void *p) {
-    Addr heapTop = (Addr)((char *)heapMem + heapSize);
-    if (p == NULL || p < heapMem || p >= heapTop)
+// remember where the application's root object is, so a heap file can be reopened from it
+void heapSetRoot(Heap h, void *root) {
+    h->root = (root == NULL) ? NONE : (Size) heapOffsetIn(h,root);
+}
+
+// the root object recorded by heapSetRoot, at its address in this mapping
+void *heapRoot(Heap h) {
+    return (h->root == NONE) ? NULL : chunkAt(h,h->root);
+}
+
+// take a snapshot of the heap's counters without walking it or taking its lock
+// chunks on quick lists count as free, chunks held in thread caches as allocated
+// polled while another thread uses the heap, each counter is read whole, but they may be from slightly different moments
+void heapStats(Heap h, HeapStats *stats) {
+    memset(stats,0,sizeof(HeapStats));
+    if (h == NULL) return;
+    stats->size = PEEK(h->size);
+    stats->freeBytes = PEEK(h->freeBytes) + PEEK(h->quickBytes);
+    stats->allocBytes = stats->size - stats->freeBytes;
+    stats->freeChunks = PEEK(h->nFree);
+    for (int i = 0; i < 64; i++) stats->freeBySize[i] = PEEK(h->freeBySize[i]);
+    stats->largestFree = PEEK(h->largest);
+    for (int i = 0; i < NQUICK; i++) {
+        int count = PEEK(h->quickCount[i]);
+        if (count == 0) continue;
+        stats->freeChunks += count;
+        stats->freeBySize[topBit(i*4)] += count;
+        if (i*4 > stats->largestFree) stats->largestFree = i*4;
+    }
+    stats->allocChunks = PEEK(h->nChunks) - stats->freeChunks;
+    if (stats->freeBytes > 0) stats->fragmentation = 1.0 - (double) stats->largestFree / stats->freeBytes;
+    stats->mallocs = PEEK(h->mallocs);
+    stats->frees = PEEK(h->frees);
+    for (ThreadCache *c = __atomic_load_n(&h->caches,__ATOMIC_ACQUIRE); c != NULL; c = c->next) {
+        stats->mallocs += PEEK(c->mallocs);                                 // owners may be mid-update, so these can lag slightly
+        stats->frees += PEEK(c->frees);
+    }
+    stats->splits = PEEK(h->splits);
+    stats->merges = PEEK(h->merges);
+    stats->mappedBytes = PEEK(h->mappedBytes);
+    stats->mappedChunks = PEEK(h->nMaps);
+}
+
+// give the pages inside large free chunks of a mapped heap back to the system
+// they read as zero when next touched
+void heapTrim(Heap h) {
+    if (h == NULL || h->reserved == 0) return;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    consolidate(h);
+    trimHeap(h);
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+}
+
+// trim a mapped heap whose lock, if any, is held
+static void trimHeap(Heap h) {
+    for (int bin = binOf(TRIM_MIN); bin < NBINS; bin++)
+        trimTree(h,h->bins[bin]);
+    h->freed = 0;
+}
+
+// release the interior pages of every free chunk in the tree rooted at root
+// the top chunk's pages go up to the end of the heap, so the high-water mark can drop to them
+static void trimTree(Heap h, Size root) {
+    if (root == NONE) return;
+    char *chunk = chunkAt(h,root);
+    Size size = chunkSize(h,root);
+    int last = (root + size == h->size && h->file == NULL);                 // pages of a file come back as they were, not zero
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t) chunk + h->node;                           // keep the index node and footer resident
+    uintptr_t to = (uintptr_t) chunk + size - (last ? 0 : h->tag);          // bar the top chunk's, which is written again
+    uintptr_t top = (uintptr_t) h->mem + h->touched + page - 1;             // pages above the high-water mark were never dirtied
+    if (to > top) to = top;
+    from = (from + page - 1) / page * page;
+    to = to / page * page;
+    if (to > from) madvise((void *) from,to - from,MADV_DONTNEED);
+    uintptr_t mark = (uintptr_t) h->mem + h->touched;
+    if (last && to > from && from < mark && (to >= (uintptr_t) chunk + size - h->tag || to >= mark)) {
+        markFree(h,root,size);                                              // the top chunk now reads as zero from page from up, bar its footer
+        h->touched = from - (uintptr_t) h->mem;
+    }
+    trimTree(h,leftOf(h,root));
+    trimTree(h,rightOf(h,root));
+}
+
+// allocate the first want bytes of the have-byte chunk at offset, which is out of the bins,
+// and give the excess back as a free chunk if it is big enough to be one
+static void takeChunk(Heap h, Size offset, Size have, Size want) {
+    Size flags = sizeWord(h,offset) & PREV_FREE;
+    setStatus(h,offset,ALLOC);
+    if (have - want < h->minChunk) {                                        // allocate entire chunk if the excess could not hold a free chunk
+        setSizeWord(h,offset,have | flags);
+        setPrevFree(h,offset + have,0);                                     // following chunk no longer sits behind a free chunk
+    } else {                                                                // split into an allocated chunk for the request and the rest as free space
+        setSizeWord(h,offset,want | flags);
+        markFree(h,offset + want,have - want);                              // upper chunk carries the free tags, the following chunk's flag is already set
+        addFree(h,offset + want);                                           // upper chunk goes into the bin for its own size
+        COUNT(h->splits,1);
+        COUNT(h->nChunks,1);
+    }
+    Size end = offset + chunkSize(h,offset);
+    if (end > h->touched) h->touched = end;
+}
+
+// allocate the top want bytes of the free chunk at offset (already out of its bin) and return their offset
+// the rest stays free below it
+static Size takeChunkHigh(Heap h, Size offset, Size have, Size want) {
+    Size top = offset + have - want;
+    markFree(h,offset,have - want);
+    addFree(h,offset);
+    setStatus(h,top,ALLOC);
+    setSizeWord(h,top,want | PREV_FREE);
+    setPrevFree(h,top + want,0);
+    COUNT(h->splits,1);
+    COUNT(h->nChunks,1);
+    if (top + want > h->touched) h->touched = top + want;
+    return top;
+}
+
+// grow or shrink the allocated chunk at offset to hold size bytes (already rounded) without moving it
+// returns 0 if it would have to move
+static int resizeChunk(Heap h, Size offset, Size size) {
+    Size flags = sizeWord(h,offset) & PREV_FREE;
+    Size have = chunkSize(h,offset);
+    Size want = size + h->hdr;
+    Size next = offset + have;
+    if (want > have) {                                                      // grow into the free chunk above, if it is big enough
+        if (next >= h->size || statusOf(h,next) != FREE) return 0;
+        Size nextSize = chunkSize(h,next);
+        if (have + nextSize < want) return 0;
+        removeFree(h,next);
+        forgetHeader(h,next,offset);
+        COUNT(h->merges,1);
+        COUNT(h->nChunks,-1);
+        takeChunk(h,offset,have + nextSize,want);
+        return 1;
+    } else if (have - want >= h->minChunk) {                                // shrink, handing the tail back as a chunk of its own
+        setSizeWord(h,offset,want | flags);
+        setStatus(h,offset + want,ALLOC);
+        setSizeWord(h,offset + want,have - want);
+        COUNT(h->splits,1);
+        COUNT(h->nChunks,1);
+        releaseChunk(h,offset + want);
+    }
+    return 1;
+}
+
+// return the chunk at offset to the bins, merging it with free neighbours
+static void releaseChunk(Heap h, Size offset) {
+    Size size = chunkSize(h,offset);
+    h->freed += size;
+
+    Size right = offset + size;                                             // physically next chunk, found from our own size
+    if (right < h->size && statusOf(h,right) == FREE) {                     // merge with the free chunk immediately above
+        removeFree(h,right);
+        forgetHeader(h,right,offset);
+        COUNT(h->merges,1);
+        COUNT(h->nChunks,-1);
+        size += chunkSize(h,right);
+    }
+    if (sizeWord(h,offset) & PREV_FREE) {                                   // merge into the free chunk immediately below, found from its footer
+        Size tag = tagBelow(h,offset);
+        Size left = offset - tag;
+        if (tag > offset || statusOf(h,left) != FREE) {
+            fprintf(stderr,"Corrupted heap footer %08lx\n",(unsigned long) tag);
+            exit(1);
+        }
+        removeFree(h,left);                                                 // lower chunk grows, so it moves to the bin for its new size
+        forgetHeader(h,offset,left);
+        COUNT(h->merges,1);
+        COUNT(h->nChunks,-1);
+        markFree(h,left,tag + size);
+        addFree(h,left);
+    } else {
+        markFree(h,offset,size);                                            // release allocated chunk
+        addFree(h,offset);
+    }
+    if (h->reserved != 0 && h->freed >= TRIM_EVERY) trimHeap(h);
+}
+
+// the header at gone has been merged into the chunk at into, so a compaction pass paused there carries on from into
+static inline void forgetHeader(Heap h, Size gone, Size into) {
+    if (h->compactAt == gone) h->compactAt = into;
+}
+
+// allocate a relocatable chunk of size bytes in heap h, returns its handle or -1 if there is no room
+// the handle's number sits in the first h->align bytes of the payload, so heapCompact can find it
+// handles are not traced, and last only as long as the heap is open; objects must be smaller than mapAbove
+Handle heapHandleAlloc(Heap h, size_t size) {
+    if (h == NULL || size < 1 || size > h->maxSize - h->align) return -1;
+    if (h->mapAbove != 0 && size + h->align >= h->mapAbove) return -1;     // only chunks in the heap can move
+    char *block = mallocBlock(h,size + h->align);
+    if (block == NULL) return -1;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    int handle = newHandle(h,(Size) heapOffsetIn(h,block) - h->hdr);
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    if (handle < 0) {
+        freeBlock(h,block);
         return -1;
+    }
+    *(uint *)block = handle;
+    return handle;
+}
+
+// address of the object behind a handle, valid until the next heapCompact, or NULL for a bad handle
+void *heapDeref(Heap h, Handle handle) {
+    if (h == NULL) return NULL;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    void *object = NULL;
+    if (handle >= 0 && handle < h->nHandles && h->handles[handle] != NONE)
+        object = chunkAt(h,h->handles[handle]) + h->hdr + h->align;
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return object;
+}
+
+// free the object behind a handle, the handle may be given out again
+void heapHandleFree(Heap h, Handle handle) {
+    if (h == NULL) return;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    Size offset = NONE;
+    if (handle >= 0 && handle < h->nHandles) offset = h->handles[handle];
+    if (offset != NONE) {
+        h->handles[handle] = NONE;
+        h->spare[h->nSpare++] = handle;
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    if (offset == NONE) {
+        fprintf(stderr,"Attempt to free unallocated handle\n");
+        exit(1);
+    }
+    freeBlock(h,chunkAt(h,offset) + h->hdr);
+}
+
+// slide relocatable chunks down into the free space below them, doing about budget bytes of work per call:
+// the bytes copied, plus a header's worth for every chunk stepped over; a budget of 0 finishes the pass
+// returns 1 while the pass has further to go, 0 once it has reached the top of the heap
+// other chunks stay where they are, so free space gathers in the gaps above them and at the top
+int heapCompact(Heap h, size_t budget) {
+    if (h == NULL) return 0;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    consolidate(h);                                                         // parked chunks would be in the way
+    Size offset = h->compactAt;
+    Size work = 0;
+    while (offset < h->size && (budget == 0 || work < budget)) {
+        Size size = chunkSize(h,offset);
+        Size next = offset + size;
+        work += h->hdr;
+        int handle = (statusOf(h,offset) == FREE && next < h->size) ? handleOf(h,next) : -1;
+        if (handle < 0) {
+            offset = next;
+            continue;
+        }
+        Size moving = chunkSize(h,next);                                    // a free chunk with a relocatable one above it: swap them
+        removeFree(h,offset);
+        memmove(chunkAt(h,offset),chunkAt(h,next),moving);
+        setSizeWord(h,offset,moving);                                       // the chunk below a free one is never free
+        h->handles[handle] = offset;
+        Size gap = offset + moving;
+        setStatus(h,gap,ALLOC);
+        setSizeWord(h,gap,size);
+        releaseChunk(h,gap);                                                // and merges with any free chunk above
+        work += moving;
+        offset = gap;
+    }
+    h->compactAt = (offset < h->size) ? offset : 0;
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return h->compactAt != 0;
+}
+
+// give a request of size bytes a mapping of its own, recorded in the heap's table, NULL if the system refuses
+static void *mapBlock(Heap h, Size size) {
+    Size page = (Size) sysconf(_SC_PAGESIZE);
+    if (size > NONE - page) return NULL;
+    size = (size + page - 1) / page * page;
+    Addr block = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (block == MAP_FAILED) return NULL;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    if (h->nMaps == h->maxMaps) {
+        int max = (h->maxMaps == 0) ? 16 : 2*h->maxMaps;
+        Mapping *maps = realloc(h->maps,max*sizeof(Mapping));
+        if (maps == NULL) {
+            if (h->concurrent) pthread_mutex_unlock(&h->lock);
+            munmap(block,size);
+            return NULL;
+        }
+        h->maps = maps;
+        h->maxMaps = max;
+    }
+    h->maps[h->nMaps] = (Mapping) { block, size };
+    COUNT(h->nMaps,1);
+    COUNT(h->mappedBytes,size);
+    COUNT(h->mallocs,1);
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return block;
+}
+
+// resize a mapped block, it stays where it is while it fits its pages and is still over the threshold
+static void *remapBlock(Heap h, void *block, Size size) {
+    Size have = mappedSize(h,block);
+    if (size <= have && size >= h->mapAbove) return block;
+    void *moved = mallocBlock(h,size);
+    if (moved == NULL) return (size <= have) ? block : NULL;                // a block that shrinks can always stay
+    memcpy(moved,block,(have < size) ? have : size);
+    freeBlock(h,block);
+    return moved;
+}
+
+// give a mapped block back to the system, returns 0 if block is not one of heap h's
+static int unmapBlock(Heap h, Addr block) {
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    int i = findMapping(h,block);
+    Mapping gone = { NULL, 0 };
+    if (i >= 0) {
+        gone = h->maps[i];
+        COUNT(h->nMaps,-1);
+        h->maps[i] = h->maps[h->nMaps];
+        COUNT(h->mappedBytes,-gone.size);
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    if (i < 0) return 0;
+    munmap(gone.block,gone.size);
+    __atomic_fetch_add(&h->frees,1,__ATOMIC_RELAXED);
+    return 1;
+}
+
+// index of the mapping that starts at block, or -1, the caller holds the lock of a concurrent heap
+static int findMapping(Heap h, Addr block) {
+    for (int i = h->nMaps - 1; i >= 0; i--)                                 // the newest are the likeliest to be freed next
+        if (h->maps[i].block == block) return i;
+    return -1;
+}
+
+// bytes mapped for a block with a mapping of its own, 0 if it does not have one
+static Size mappedSize(Heap h, Addr block) {
+    if (h->mapAbove == 0 || block == NULL) return 0;
+    if (h->concurrent) pthread_mutex_lock(&h->lock);
+    int i = findMapping(h,block);
+    Size size = (i < 0) ? 0 : h->maps[i].size;
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
+    return size;
+}
+
+// record a new handle for the chunk at offset, growing the table if need be, returns -1 if it cannot
+static int newHandle(Heap h, Size offset) {
+    if (h->nSpare > 0) {
+        int handle = h->spare[--h->nSpare];
+        h->handles[handle] = offset;
+        return handle;
+    }
+    if (h->nHandles == h->maxHandles) {
+        int max = (h->maxHandles == 0) ? 64 : 2*h->maxHandles;
+        Size *handles = realloc(h->handles,max*sizeof(Size));
+        if (handles != NULL) h->handles = handles;
+        int *spare = realloc(h->spare,max*sizeof(int));
+        if (spare != NULL) h->spare = spare;
+        if (handles == NULL || spare == NULL) return -1;
+        h->maxHandles = max;
+    }
+    h->handles[h->nHandles] = offset;
+    return h->nHandles++;
+}
+
+// handle of the allocated chunk at offset, or -1 if it is not relocatable
+// the number in front of its payload is only believed if the handle points back at it
+static int handleOf(Heap h, Size offset) {
+    if (statusOf(h,offset) != ALLOC) return -1;
+    uint handle = *(uint *)(chunkAt(h,offset) + h->hdr);
+    return (handle < (uint) h->nHandles && h->handles[handle] == offset) ? (int) handle : -1;
+}
+
+// allocate from a concurrent heap: small chunks come from the thread's cache, which
+// is refilled in batches, everything else takes the lock
+static void *cacheMalloc(Heap h, Size size) {
+    int cls = (size + h->hdr)/4;
+    int small = (size + h->hdr < SMALL_MAX);
+    ThreadCache *cache = threadCache(h);
+    if (!small || cache == NULL || cache->head[cls] == NONE) {
+        pthread_mutex_lock(&h->lock);
+        drainPending(h);                                                    // chunks freed elsewhere may be what we need
+        Addr block = allocChunk(h,size);
+        if (block == NULL && cache != NULL) {                               // last resort, give back what this thread is holding
+            flushCache(cache);
+            block = allocChunk(h,size);
+        }
+        if (block != NULL) COUNT(h->mallocs,1);
+        if (small && cache != NULL && block != NULL) {
+            for (int i = 1; i < CACHE_FILL; i++) {                          // stock up the cache while holding the lock
+                if (findFit(h,size) == NONE) break;                         // never grow the heap just to fill a cache
+                Addr extra = allocChunk(h,size);
+                Size offset = (Size) heapOffsetIn(h,extra) - h->hdr;
+                setStatus(h,offset,CACHED);
+                setLink(h,offset,cache->head[cls]);
+                cache->head[cls] = offset;
+                cache->count[cls]++;
+            }
+        }
+        pthread_mutex_unlock(&h->lock);
+        return block;
+    }
+
+    Size offset = cache->head[cls];                                         // fast path, no lock
+    cache->head[cls] = linkOf(h,offset);
+    cache->count[cls]--;
+    COUNT(cache->mallocs,1);                                                // only this thread writes it, heapStats reads it
+    setStatus(h,offset,ALLOC);
+    return chunkAt(h,offset) + h->hdr;
+}
+
+// free into a concurrent heap: small chunks go to the thread's cache, overflowing
+// caches and contended large frees go onto the lock-free pending stack
+static void cacheFree(Heap h, Size offset) {
+    Size size = chunkSize(h,offset);
+    ThreadCache *cache = (size < SMALL_MAX) ? threadCache(h) : NULL;
+    setStatus(h,offset,CACHED);
+    if (cache == NULL) {
+        __atomic_fetch_add(&h->frees,1,__ATOMIC_RELAXED);                  // may not hold the lock
+        if (pthread_mutex_trylock(&h->lock) == 0) {
+            drainPending(h);
+            releaseChunk(h,offset);
+            pthread_mutex_unlock(&h->lock);
+        } else {
+            pushPending(h,offset,offset);                                   // whoever holds the lock will pick it up
+        }
+        return;
+    }
+
+    int cls = size/4;
+    COUNT(cache->frees,1);
+    setLink(h,offset,cache->head[cls]);
+    cache->head[cls] = offset;
+    if (++cache->count[cls] <= CACHE_MAX) return;
+
+    Size first = cache->head[cls], last = first;                            // hand the older half back without taking the lock
+    for (int i = 1; i < CACHE_MAX/2; i++) last = linkOf(h,last);
+    cache->head[cls] = linkOf(h,last);
+    cache->count[cls] -= CACHE_MAX/2;
+    pushPending(h,first,last);
+}
+
+// returns this thread's cache for concurrent heap h, taking over a parked one or creating one on first use, NULL if no memory
+static ThreadCache *threadCache(Heap h) {
+    ThreadCache *cache = pthread_getspecific(h->cacheKey);
+    if (cache != NULL) return cache;
+    pthread_mutex_lock(&h->lock);
+    for (cache = h->caches; cache != NULL && !cache->parked; cache = cache->next) ;
+    if (cache != NULL) {
+        cache->parked = 0;                                                  // its counts carry on from the thread before
+    } else if ((cache = malloc(sizeof(ThreadCache))) != NULL) {
+        cache->heap = h;
+        for (int i = 0; i < NSMALL; i++) {
+            cache->head[i] = NONE;
+            cache->count[i] = 0;
+        }
+        cache->mallocs = cache->frees = 0;
+        cache->parked = 0;
+        cache->next = h->caches;
+        __atomic_store_n(&h->caches,cache,__ATOMIC_RELEASE);                // heapStats walks the list without the lock
+    }
+    pthread_mutex_unlock(&h->lock);
+    if (cache != NULL) pthread_setspecific(h->cacheKey,cache);
+    return cache;
+}
+
+// thread exit: return everything in the thread's cache to the bins and park the cache
+// it is not freed, so heapStats can go on reading its counts, until the heap is destroyed
+static void cacheExit(void *cache) {
+    ThreadCache *tc = cache;
+    Heap h = tc->heap;
+    pthread_mutex_lock(&h->lock);
+    flushCache(tc);
+    tc->parked = 1;
+    pthread_mutex_unlock(&h->lock);
+}
+
+// release every chunk held by a cache, the heap's lock must be held
+static void flushCache(ThreadCache *cache) {
+    Heap h = cache->heap;
+    for (int i = 0; i < NSMALL; i++) {
+        while (cache->head[i] != NONE) {
+            Size offset = cache->head[i];
+            cache->head[i] = linkOf(h,offset);
+            releaseChunk(h,offset);
+        }
+        cache->count[i] = 0;
+    }
+}
+
+// push a chain of CACHED chunks, already linked from first to last, onto the pending stack
+static void pushPending(Heap h, Size first, Size last) {
+    Size old = __atomic_load_n(&h->pending,__ATOMIC_RELAXED);
+    do {
+        setLink(h,last,old);
+    } while (!__atomic_compare_exchange_n(&h->pending,&old,first,1,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+}
+
+// return every chunk on the pending stack to the bins, the heap's lock must be held
+static void drainPending(Heap h) {
+    Size offset = __atomic_exchange_n(&h->pending,NONE,__ATOMIC_ACQUIRE);   // take the whole stack at once, so no ABA
+    while (offset != NONE) {
+        Size next = linkOf(h,offset);
+        releaseChunk(h,offset);
+        offset = next;
+    }
+}
+
+// link of a CACHED chunk, kept in the first word of its payload
+static Size linkOf(Heap h, Size offset) {
+    char *link = chunkAt(h,offset) + h->hdr;
+    if (h->wide) return *(Size *)link;
+    uint narrow = *(uint *)link;
+    return (narrow == (uint) NONE) ? NONE : narrow;
+}
+
+static void setLink(Heap h, Size offset, Size link) {
+    char *word = chunkAt(h,offset) + h->hdr;
+    if (h->wide)
+        *(Size *)word = link;
     else
-        return p - heapMem;
+        *(uint *)word = (uint) link;
 }
 
-// dump contents of heap (for testing/debugging)
-void dumpHeap() {
-    Addr    curr;
-    Header *chunk;
-    Addr    endHeap = (Addr)((char *)heapMem + heapSize);
+// convert pointer to offset in the memory of heap h
+// -2 for a block with a mapping of its own, -1 for anything else outside the heap
+long heapOffsetIn(Heap h, void *p) {
+    if (h == NULL) return -1;
+    Addr heapTop = (Addr)((char *)h->mem + h->size);
+    if (p == NULL || p < h->mem || p >= heapTop)
+        return (mappedSize(h,p) != 0) ? -2 : -1;
+    else
+        return (char *)p - (char *)h->mem;
+}
+
+// dump contents of heap h (for testing/debugging)
+// the quick lists and pending stack are emptied first, chunks held in thread caches of a concurrent heap show as allocated
+void heapDump(Heap h) {
+    Size    curr;
     int     onRow = 0;
 
-    curr = heapMem;
-    while (curr < endHeap) {
+    if (h->concurrent) {
+        pthread_mutex_lock(&h->lock);
+        drainPending(h);                                                    // chunks other threads freed go back to the bins
+    }
+    consolidate(h);
+    curr = 0;
+    while (curr < h->size) {
         char stat;
-        chunk = (Header *)curr;
-        switch (chunk->status) {
-        case FREE:  stat = 'F'; break;
-        case ALLOC: stat = 'A'; break;
-        default:    fprintf(stderr,"Corrupted heap %08x\n",chunk->status); exit(1); break;
+        switch (statusOf(h,curr)) {
+        case FREE:   stat = 'F'; break;
+        case ALLOC:
+        case CACHED: stat = 'A'; break;
+        default:     fprintf(stderr,"Corrupted heap %08x\n",*(uint *)chunkAt(h,curr)); exit(1); break;
         }
-        printf("+%05d (%c,%5d) ", heapOffset(curr), stat, chunk->size);
+        printf("+%05ld (%c,%5ld) ", (long) curr, stat, (long) chunkSize(h,curr));
         onRow++;
         if (onRow%5 == 0) printf("\n");
-        curr = (Addr)((char *)curr + chunk->size);
+        curr += chunkSize(h,curr);
     }
     if (onRow > 0) printf("\n");
+    for (int i = 0; i < h->nMaps; i++) {                                    // blocks with mappings of their own, newest last
+        printf("%s(M,%5ld) ", (i%5 == 0) ? "mapped " : "", (long) h->maps[i].size);
+        if (i%5 == 4 || i == h->nMaps - 1) printf("\n");
+    }
+    if (h->concurrent) pthread_mutex_unlock(&h->lock);
 }
 
-// uses a simple Bubble Sort to sort freeList in ascending address order
-static void sortFreeList() {
-    Addr tmp;
+// convert an offset in the memory of heap h to the address of the chunk stored there
+static inline char *chunkAt(Heap h, Size offset) {
+    return (char *)h->mem + offset;
+}
 
-    for (int i = 0; i < nFree; i++) {
-        for (int j = 0; j < (nFree-i); j++) {
-            if (freeList[j] != NULL && freeList[j+1] != NULL) {
-                if (freeList[j] > freeList[j+1]) {
-                    tmp = freeList[j];
-                    freeList[j] = freeList[j+1];
-                    freeList[j+1] = tmp;
-                }
-            }
+// the fields of a chunk's header, which is a Header or a WideHeader depending on the heap
+// status comes first in both; these are inline as every walk of the heap goes through them
+// a compact header's status is decoded from its flag bits, and is 0 if its parity is wrong
+// in a concurrent heap the thread caches set status words without the lock, while the lock holder
+// reads them and flips PREV_FREE in size words that a lock-free free reads, so these go through atomics
+// (relaxed, as the lock and the pending stack order everything else); compact heaps are never concurrent
+static inline uint statusOf(Heap h, Size offset) {
+    if (!h->compact) return __atomic_load_n(&((Header *)chunkAt(h,offset))->status,__ATOMIC_RELAXED);
+    uint word = *(uint *)chunkAt(h,offset);
+    if (__builtin_parity(word)) return 0;
+    if (!(word & IN_USE)) return FREE;
+    return (word & PARKED) ? CACHED : ALLOC;
+}
+
+// the status and size of a compact header may be set in either order, each keeps the other's bits
+static inline void setStatus(Heap h, Size offset, uint status) {
+    if (!h->compact) {
+        __atomic_store_n(&((Header *)chunkAt(h,offset))->status,status,__ATOMIC_RELAXED);
+        return;
+    }
+    uint *header = (uint *)chunkAt(h,offset);
+    uint word = *header & ~(IN_USE|PARKED|PARITY);
+    if (status != FREE) word |= IN_USE;
+    if (status == CACHED) word |= PARKED;
+    *header = word | (__builtin_parity(word) ? PARITY : 0);
+}
+
+// size of a chunk with its flag bits
+static inline Size sizeWord(Heap h, Size offset) {
+    if (h->wide) return __atomic_load_n(&((WideHeader *)chunkAt(h,offset))->size,__ATOMIC_RELAXED);
+    if (h->compact) return *(uint *)chunkAt(h,offset) & ~(IN_USE|PARKED|PARITY);
+    return __atomic_load_n(&((Header *)chunkAt(h,offset))->size,__ATOMIC_RELAXED);
+}
+
+static inline void setSizeWord(Heap h, Size offset, Size word) {
+    if (h->wide) {
+        __atomic_store_n(&((WideHeader *)chunkAt(h,offset))->size,word,__ATOMIC_RELAXED);
+    } else if (h->compact) {
+        uint *header = (uint *)chunkAt(h,offset);
+        uint bits = word | (*header & (IN_USE|PARKED));
+        *header = bits | (__builtin_parity(bits) ? PARITY : 0);
+    } else {
+        __atomic_store_n(&((Header *)chunkAt(h,offset))->size,(uint) word,__ATOMIC_RELAXED);
+    }
+}
+
+// size of a chunk in bytes, without the flag bits
+static inline Size chunkSize(Heap h, Size offset) {
+    return sizeWord(h,offset) & ~(Size) SIZE_BITS;
+}
+
+// size in the boundary tag of the free chunk that ends at offset
+static inline Size tagBelow(Heap h, Size offset) {
+    char *tag = chunkAt(h,offset) - h->tag;
+    return h->wide ? *(Size *)tag : *(uint *)tag;
+}
+
+// links of a free chunk's index node, an empty narrow link reads as NONE
+// a FreeChunk and a CompactFreeChunk differ only in their header, so their node is found past h->hdr
+static inline uint *nodeOf(Heap h, Size offset) {
+    return (uint *)(chunkAt(h,offset) + h->hdr);
+}
+
+static inline Size leftOf(Heap h, Size offset) {
+    if (h->wide) return ((WideFreeChunk *)chunkAt(h,offset))->left;
+    uint link = nodeOf(h,offset)[0];
+    return (link == (uint) NONE) ? NONE : link;
+}
+
+static inline Size rightOf(Heap h, Size offset) {
+    if (h->wide) return ((WideFreeChunk *)chunkAt(h,offset))->right;
+    uint link = nodeOf(h,offset)[1];
+    return (link == (uint) NONE) ? NONE : link;
+}
+
+static inline void setLeft(Heap h, Size offset, Size link) {
+    if (h->wide)
+        ((WideFreeChunk *)chunkAt(h,offset))->left = link;
+    else
+        nodeOf(h,offset)[0] = link;
+}
+
+static inline void setRight(Heap h, Size offset, Size link) {
+    if (h->wide)
+        ((WideFreeChunk *)chunkAt(h,offset))->right = link;
+    else
+        nodeOf(h,offset)[1] = link;
+}
+
+// write the header and footer of a free chunk and flag it in the chunk that follows
+static void markFree(Heap h, Size offset, Size size) {
+    setStatus(h,offset,FREE);
+    setSizeWord(h,offset,size);                                             // a free chunk is never preceded by another free chunk
+    char *tag = chunkAt(h,offset + size) - h->tag;
+    if (h->wide)
+        *(Size *)tag = size;
+    else
+        *(uint *)tag = size;
+    setPrevFree(h,offset + size,1);
+}
+
+// set or clear the PREV_FREE flag of the chunk at offset, if there is one
+static void setPrevFree(Heap h, Size offset, int isFree) {
+    if (offset >= h->size) {
+        if (offset == h->size) h->lastFree = isFree;                        // remembered for when the heap grows
+        return;
+    }
+    if (isFree)
+        setSizeWord(h,offset,sizeWord(h,offset) | PREV_FREE);
+    else
+        setSizeWord(h,offset,sizeWord(h,offset) & ~(Size) PREV_FREE);
+}
+
+// position of the highest set bit of a non-zero size
+static inline int topBit(Size size) {
+    return 63 - __builtin_clzll(size);
+}
+
+// index of the bin holding free chunks of the given size
+static inline int binOf(Size size) {
+    if (size < SMALL_MAX) return size/4;
+    int lg = topBit(size);                                                  // size lies in [2^lg, 2^(lg+1)), split into two halves
+    return NSMALL + 2*(lg - 8) + ((size >> (lg - 1)) & 1);
+}
+
+// index of the first non-empty bin above bin, or -1 if there is none
+static int nextBin(Heap h, int bin) {
+    bin++;
+    for (int w = bin/32; w < (NBINS + 31)/32; w++) {
+        uint bits = h->binMap[w];
+        if (w == bin/32) bits &= ~0U << (bin%32);                           // ignore bins below the starting one
+        if (bits != 0) return w*32 + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+// put the free chunk at offset into the bin for its size
+static void addFree(Heap h, Size offset) {
+    Size size = chunkSize(h,offset);
+    int bin = binOf(size);
+    h->bins[bin] = treeInsert(h,h->bins[bin],offset);
+    h->binMap[bin/32] |= 1U << (bin%32);
+    COUNT(h->nFree,1);
+    COUNT(h->freeBytes,size);
+    COUNT(h->freeBySize[topBit(size)],1);
+    if (size > h->largest) STORE(h->largest,size);
+}
+
+// take the free chunk at offset out of its bin, must be done before its size changes
+static void removeFree(Heap h, Size offset) {
+    Size size = chunkSize(h,offset);
+    int bin = binOf(size);
+    h->bins[bin] = treeRemove(h,h->bins[bin],offset);
+    if (h->bins[bin] == NONE) h->binMap[bin/32] &= ~(1U << (bin%32));
+    COUNT(h->nFree,-1);
+    COUNT(h->freeBytes,-size);
+    COUNT(h->freeBySize[topBit(size)],-1);
+    if (size == h->largest) {                                               // the next biggest is in the top bin left
+        Size top = largestChunk(h);
+        STORE(h->largest,(top == NONE) ? 0 : chunkSize(h,top));
+    }
+}
+
+// returns the offset of the free chunk the heap's policy picks for size bytes, or NONE
+static Size findFit(Heap h, Size size) {
+    if (h->policy == HEAP_BEST_FIT) return findSmallestChunk(h,size);
+    if (h->policy == HEAP_FIRST_FIT) return findFirstChunk(h,size,0);
+    Size offset = findFirstChunk(h,size,h->rover);
+    if (offset == NONE && h->rover != 0) offset = findFirstChunk(h,size,0);   // wrap round to the bottom of the heap
+    if (offset != NONE) h->rover = offset;
+    return offset;
+}
+
+// returns the offset of the smallest usable free chunk, if none can be found NONE is returned instead
+// the lowest address wins between chunks of the same size
+static Size findSmallestChunk(Heap h, Size size) {
+    Size need = size + h->hdr;
+    int bin = binOf(need);
+    Size best = treeFit(h,h->bins[bin],need);                               // chunks in the same bin may still be too small
+    if (best == NONE) {
+        bin = nextBin(h,bin);                                               // every chunk in a later bin fits, so take the smallest there
+        if (bin != -1) best = treeMin(h,h->bins[bin]);
+    }
+    return best;
+}
+
+// returns the offset of the lowest-addressed free chunk at or above from that holds size bytes, or NONE
+// bins are in address order under this policy, each gives its candidate in O(log n) by passing over subtrees too small to hold it
+static Size findFirstChunk(Heap h, Size size, Size from) {
+    Size need = size + h->hdr;
+    Size first = NONE;
+    for (int bin = binOf(need); bin != -1; bin = nextBin(h,bin)) {
+        Size offset = treeFirstFit(h,h->bins[bin],need,from);
+        if (offset < first) first = offset;                                 // NONE is above every offset
+    }
+    return first;
+}
+
+// offset of the largest free chunk, found in the highest non-empty bin, or NONE
+static Size largestChunk(Heap h) {
+    for (int w = (NBINS + 31)/32 - 1; w >= 0; w--) {
+        if (h->binMap[w] == 0) continue;
+        Size root = h->bins[w*32 + 31 - __builtin_clz(h->binMap[w])];
+        if (h->policy != HEAP_BEST_FIT) {                                   // in address order, so follow the subtrees holding the biggest
+            Size largest = largestIn(h,root);
+            while (chunkSize(h,root) != largest)
+                root = (largestIn(h,leftOf(h,root)) == largest) ? leftOf(h,root) : rightOf(h,root);
+            return root;
         }
+        while (rightOf(h,root) != NONE) root = rightOf(h,root);
+        return root;
     }
+    return NONE;
 }
 
-// returns the index of the samllest usable chunk in FreeList, if none can be found -1 is returned instead
-static int findSmallestChunk(int size) {
-    int index = -1;
-    Header *temp, *check;
-    
-    for (int i = 0; i < nFree; i++) {
-        temp = (Header *)freeList[i];
-        if (temp->size >= (size + 8)) {
-            if (index == -1 || check->size > temp->size) {
-                index = i;
-                check = (Header *)freeList[index];
-            }
+// ordering of chunks within a bin: by size, then by address, or by address alone for first-fit and next-fit
+static inline int keyBefore(Heap h, Size a, Size b) {
+    if (h->policy != HEAP_BEST_FIT) return a < b;
+    Size sa = chunkSize(h,a), sb = chunkSize(h,b);
+    return (sa < sb) || (sa == sb && a < b);
+}
+
+// returns the offset of the first chunk in the subtree of at least size bytes, or NONE
+static Size treeFit(Heap h, Size root, Size size) {
+    Size found = NONE;
+    while (root != NONE) {
+        if (chunkSize(h,root) >= size) {
+            found = root;
+            root = leftOf(h,root);
+        } else {
+            root = rightOf(h,root);
         }
     }
-    
-    return index;
-}
-
-// given index of a NULL address, this function moves it to the back of the freeList array
-static void organiseNULL(int index) {
-    for (int i = index; i < freeElems; i++) {
-        if (freeList[i+1] == NULL) break;
-        freeList[i] = freeList[i+1];
-        freeList[i+1] = NULL;
-    }
-}
-
-// given the start address of a free-space chunk, return its index in the freeList array
-static int findAddressInFreeList(void *address) {
-    for (int i = 0; i < nFree; i++) {
-        Addr curr = heapMem;
-        uint offset = (uint) heapOffset(freeList[i]);                       // get address offset of chunk from heapMem
-        curr = (Addr) ((char *)curr + offset);                              // add offset to get address of chunk
-        if (curr == address) return i;
-    }
-    
-    return 0;
-}
-
-// check if the next free chunk on the left of the given free chunk is adjacent to it, and if so, merge them
-static void adjacentLeft(int index, void *address) {
-    Addr curr = heapMem;
-    uint offset = (uint) heapOffset(freeList[index-1]);                     // get address offset of chunk from heapMem
-    curr = (Addr) ((char *)curr + offset);                                  // add offset to get address of chunk
-    uint difference = (uint) (address - curr);                              // get offset between the base addresses of the chunks
-    
-    Header *temp = (Header *)curr, *base = (Header *)address;
-    if (temp->size == difference) {
-        temp->size += base->size;                                           // merge free chunks together
-        freeList[index] = NULL;                                             // remove reference to adjacent chunk
-        nFree--;
-        organiseNULL(index);                                                // move new NULL entry to back of array to retain sorted ascending address order
-        address = curr;                                                     // set address to the address of the previous left adjacent chunk
-    }
-}
-
-// check if the next free chunk on the right of the given free chunk is adjacent to it, and if so, merge them
-static void adjacentRight(int index, void *address) {
-    Addr curr = heapMem;
-    uint offset = (uint) heapOffset(freeList[index+1]);                     // get address offset of chunk from heapMem
-    curr = (Addr) ((char *)curr + offset);                                  // add offset to get address of chunk
-    uint difference = (uint) (curr - address);                              // get offset between the base addresses of the chunks
-    
-    Header *temp = (Header *)curr, *base = (Header *)address;
-    if (base->size == difference) {
-        base->size += temp->size;                                           // merge free chunks together
-        freeList[index+1] = NULL;                                           // remove reference to adjacent chunk
-        nFree--;
-        organiseNULL(index+1);                                              // move new NULL entry to back of array to retain sorted ascending address order
+    return found;
+}
+
+// returns the offset of the lowest-addressed chunk at or above from of at least size bytes in an address-ordered subtree, or NONE
+static Size treeFirstFit(Heap h, Size root, Size size, Size from) {
+    if (largestIn(h,root) < size) return NONE;                              // also true of an empty subtree
+    if (root >= from) {
+        Size found = treeFirstFit(h,leftOf(h,root),size,from);
+        if (found != NONE) return found;
+        if (chunkSize(h,root) >= size) return root;
     }
+    return treeFirstFit(h,rightOf(h,root),size,from);
+}
+
+// returns the offset of the first chunk in a non-empty subtree
+static Size treeMin(Heap h, Size root) {
+    while (leftOf(h,root) != NONE) root = leftOf(h,root);
+    return root;
+}
+
+// add the free chunk at offset to the subtree rooted at root, returns the new root
+static Size treeInsert(Heap h, Size root, Size offset) {
+    if (root == NONE) {
+        setLeft(h,offset,NONE);
+        setRight(h,offset,NONE);
+        fixHeight(h,offset);
+        return offset;
+    }
+    if (keyBefore(h,offset,root))
+        setLeft(h,root,treeInsert(h,leftOf(h,root),offset));
+    else
+        setRight(h,root,treeInsert(h,rightOf(h,root),offset));
+    return rebalance(h,root);
+}
+
+// take the free chunk at offset out of the subtree rooted at root, returns the new root
+static Size treeRemove(Heap h, Size root, Size offset) {
+    if (root == NONE) return NONE;
+    if (keyBefore(h,offset,root)) {
+        setLeft(h,root,treeRemove(h,leftOf(h,root),offset));
+    } else if (keyBefore(h,root,offset)) {
+        setRight(h,root,treeRemove(h,rightOf(h,root),offset));
+    } else {
+        Size left = leftOf(h,root), right = rightOf(h,root);
+        if (left == NONE) return right;                                     // at most one child, it simply takes this chunk's place
+        if (right == NONE) return left;
+        Size succ;                                                          // otherwise the in-order successor takes its place
+        right = treeRemoveMin(h,right,&succ);
+        setLeft(h,succ,left);
+        setRight(h,succ,right);
+        root = succ;
+    }
+    return rebalance(h,root);
+}
+
+// take the first chunk out of the subtree rooted at root, returns the new root
+static Size treeRemoveMin(Heap h, Size root, Size *min) {
+    if (leftOf(h,root) == NONE) {
+        *min = root;
+        return rightOf(h,root);
+    }
+    setLeft(h,root,treeRemoveMin(h,leftOf(h,root),min));
+    return rebalance(h,root);
+}
+
+// restore the AVL balance condition at root after one of its subtrees changed height by one
+static Size rebalance(Heap h, Size root) {
+    Size left = leftOf(h,root), right = rightOf(h,root);
+    int balance = height(h,left) - height(h,right);
+    if (balance > 1) {
+        if (height(h,leftOf(h,left)) < height(h,rightOf(h,left)))
+            setLeft(h,root,rotateLeft(h,left));
+        return rotateRight(h,root);
+    }
+    if (balance < -1) {
+        if (height(h,rightOf(h,right)) < height(h,leftOf(h,right)))
+            setRight(h,root,rotateRight(h,right));
+        return rotateLeft(h,root);
+    }
+    fixHeight(h,root);
+    return root;
+}
+
+static Size rotateLeft(Heap h, Size root) {
+    Size newRoot = rightOf(h,root);
+    setRight(h,root,leftOf(h,newRoot));
+    setLeft(h,newRoot,root);
+    fixHeight(h,root);
+    fixHeight(h,newRoot);
+    return newRoot;
+}
+
+static Size rotateRight(Heap h, Size root) {
+    Size newRoot = leftOf(h,root);
+    setLeft(h,root,rightOf(h,newRoot));
+    setRight(h,newRoot,root);
+    fixHeight(h,root);
+    fixHeight(h,newRoot);
+    return newRoot;
+}
+
+static inline int height(Heap h, Size root) {
+    if (root == NONE) return 0;
+    if (h->wide) return ((WideFreeChunk *)chunkAt(h,root))->height;
+    return nodeOf(h,root)[2];
+}
+
+// recompute the height of root, and the size of the biggest chunk under it in an address-ordered bin, from its children
+static inline void fixHeight(Heap h, Size root) {
+    Size left = leftOf(h,root), right = rightOf(h,root);
+    int lh = height(h,left), rh = height(h,right);
+    if (h->wide)
+        ((WideFreeChunk *)chunkAt(h,root))->height = 1 + ((lh > rh) ? lh : rh);
+    else
+        nodeOf(h,root)[2] = 1 + ((lh > rh) ? lh : rh);
+    if (h->policy == HEAP_BEST_FIT) return;                                 // a size-ordered bin's biggest chunk is simply its last
+    Size largest = chunkSize(h,root);
+    if (largestIn(h,left) > largest) largest = largestIn(h,left);
+    if (largestIn(h,right) > largest) largest = largestIn(h,right);
+    if (h->wide)
+        ((WideFreeChunk *)chunkAt(h,root))->largest = largest;
+    else
+        nodeOf(h,root)[3] = largest;
+}
+
+// size of the biggest chunk in an address-ordered subtree, 0 if it is empty
+static inline Size largestIn(Heap h, Size root) {
+    if (root == NONE) return 0;
+    if (h->wide) return ((WideFreeChunk *)chunkAt(h,root))->largest;
+    return nodeOf(h,root)[3];
 }
@@ -4,22 +4,184 @@
 #ifndef MYHEAP_H
 #define MYHEAP_H
 
+#include <stddef.h>
+
+// handle on an independent heap instance
+typedef struct heap *Heap;
+
+// number standing for a relocatable object, see heapHandleAlloc
+typedef int Handle;
+
+// placement policies, how a heap picks the free chunk for a request
+#define HEAP_BEST_FIT  0   // the smallest chunk that fits, lowest address between equals
+#define HEAP_FIRST_FIT 1   // the lowest-addressed chunk that fits
+#define HEAP_NEXT_FIT  2   // the first chunk that fits at or above the last one picked, wrapping round
+
+// options for creating a heap, fields left zero get the default behaviour
+typedef struct {
+    size_t size;       // number of bytes in the heap
+    int  concurrent;   // non-zero if several threads may use the heap at once
+    int  align;        // minimum alignment of every chunk (power of two, default 4, or 8 in a heap of 4GiB or more)
+    size_t maxSize;    // ceiling a heap may grow to when it runs out, default is a fixed size
+    size_t growBy;     // bytes added each time a growable heap runs out, default doubles it
+    int  mapped;       // non-zero to map the heap from the system and return unused pages to it
+    int  hugePages;    // non-zero to ask for transparent huge pages in a mapped heap
+    const char *path;  // file to keep the heap in, reopened with its chunks if it already holds one, by one heap at a time
+    const char *trace; // file to record every call in, see Trace.h
+    int  policy;       // placement policy, default HEAP_BEST_FIT
+    size_t highAbove;  // requests of at least this many bytes are carved from the high end of their chunk, default never
+    int  compact;      // non-zero for 4-byte chunk headers, in a heap under 1GiB used by one thread
+    size_t mapAbove;   // requests of at least this many bytes get a mapping of their own outside the heap, default never
+    size_t sampleEvery; // profile one allocation for about every this many bytes allocated, default off, see heapProfileDump
+} HeapConfig;
+
+// counters reported by heapStats, all kept up to date as the heap is used
+typedef struct {
+    long   size;            // bytes in the heap
+    long   allocBytes;      // bytes in allocated chunks, headers included
+    long   freeBytes;       // bytes in free chunks
+    long   allocChunks;     // number of allocated chunks
+    long   freeChunks;      // number of free chunks
+    long   largestFree;     // size of the largest free chunk
+    double fragmentation;   // share of free bytes outside the largest free chunk
+    long   mallocs;         // allocations and frees since the heap was created or opened
+    long   frees;
+    long   splits;          // free chunks split to serve a request
+    long   merges;          // free chunks merged with a neighbour
+    long   mappedBytes;     // bytes in blocks with mappings of their own, not counted above
+    long   mappedChunks;    // number of those blocks
+    int    freeBySize[64];  // free chunks of size [2^i, 2^(i+1)) for each i
+} HeapStats;
+
 // initialise heap
-int initHeap(int size);
+int initHeap(size_t size);
+int initHeapWith(HeapConfig *);
 
 // clean heap
 void freeHeap();
 
 // allocate a chunk of memory
-void *myMalloc(int size);
+void *myMalloc(size_t size);
 
 // free a chunk of memory
 void myFree(void *block);
 
+// resize a chunk of memory, moving it only if it cannot grow in place
+void *myRealloc(void *block, size_t size);
+
+// allocate a zeroed array of nelem elements of size bytes each
+void *myCalloc(size_t nelem, size_t size);
+
+// allocate a chunk of memory whose address is a multiple of alignment
+void *myMemalign(size_t alignment, size_t size);
+
+// allocate count chunks of size bytes into out, returns how many it could allocate
+int myMallocBatch(size_t size, int count, void **out);
+
+// free n chunks at once, ptrs is left sorted by address
+void myFreeBatch(void **ptrs, int n);
+
+// allocate, reach and free a relocatable object, only these are moved by myCompact
+Handle myHandleAlloc(size_t size);
+void *myDeref(Handle);
+void myHandleFree(Handle);
+
+// move relocatable objects down to gather free space, doing about budget bytes of work, returns 1 if there is more to do
+int myCompact(size_t budget);
+
 // dump contents of heap (for testing/debugging)
 void dumpHeap();
 
-// convert pointer to offset in heapMem
-int  heapOffset(void *);
+// print the heap's allocation profile, see heapProfileDump
+void dumpProfile(int inUse);
+
+// fill in the counters of the default heap, see heapStats
+void myHeapStats(HeapStats *);
+
+// number of the current default heap, a new one after each initHeap or freeHeap
+// so code keeping memory from the default heap between calls can tell when it went
+int myHeapNumber();
+
+// convert pointer to offset in heapMem, -2 for a block with a mapping of its own, else -1 if it is outside
+long heapOffset(void *);
+
+// the functions above all work on a default heap set up by initHeap
+// the ones below work on any heap created by heapCreate
+
+// create a heap of (at least) size bytes, NULL if no memory
+// chunks in a heap that can reach 4GiB have 16-byte headers, smaller heaps keep narrow 8-byte ones (or 4-byte ones, see HeapConfig.compact)
+Heap heapCreate(size_t size);
+Heap heapCreateWith(HeapConfig *);
+
+// release a heap and every chunk in it, or save and close a heap file
+void heapDestroy(Heap);
+
+// allocate a chunk of memory from a heap
+void *heapMalloc(Heap, size_t size);
+
+// free a chunk of memory allocated from a heap
+void heapFree(Heap, void *block);
+
+// resize and zero-allocate chunks in a heap
+void *heapRealloc(Heap, void *block, size_t size);
+void *heapCalloc(Heap, size_t nelem, size_t size);
+void *heapMemalign(Heap, size_t alignment, size_t size);
+
+// allocate and free many chunks in a heap at once
+int  heapMallocBatch(Heap, size_t size, int count, void **out);
+void heapFreeBatch(Heap, void **ptrs, int n);
+
+// relocatable objects in a heap, the address from heapDeref is good until the next heapCompact
+Handle heapHandleAlloc(Heap, size_t size);
+void *heapDeref(Heap, Handle);
+void heapHandleFree(Heap, Handle);
+
+// slide relocatable objects down into free space, about budget bytes of work per call (0 for a whole pass)
+// returns 1 while the pass has further to go, 0 once free space is gathered at the top and above unmovable chunks
+int heapCompact(Heap, size_t budget);
+
+// record and find the application's root object, kept across reopening a heap file
+void heapSetRoot(Heap, void *root);
+void *heapRoot(Heap);
+
+// fill in the counters of a heap in constant time, without taking its lock
+// any heap may be polled from another thread while it is in use, until it is destroyed
+void heapStats(Heap, HeapStats *);
+
+// return the unused pages inside large free chunks of a mapped or growable heap to the system
+void heapTrim(Heap);
+
+// dump contents of a heap (for testing/debugging)
+void heapDump(Heap);
+
+// print a heap's allocation profile as collapsed stacks, one "site bytes" line per call site, for flame graph tools
+// the bytes are estimated from the samples, of those still in use if inUse is non-zero, else of all allocated
+void heapProfileDump(Heap, int inUse);
+
+// allocation calls that say which call site to charge in the profile, "?" for the plain ones
+// the site string must last as long as the heap
+void *myMallocAt(size_t size, const char *site);
+void *myReallocAt(void *block, size_t size, const char *site);
+void *myCallocAt(size_t nelem, size_t size, const char *site);
+void *heapMallocAt(Heap, size_t size, const char *site);
+void *heapReallocAt(Heap, void *block, size_t size, const char *site);
+void *heapCallocAt(Heap, size_t nelem, size_t size, const char *site);
+
+// convert pointer to offset in a heap's memory, -2 for a block with a mapping of its own, else -1 if it is outside
+long heapOffsetIn(Heap, void *);
+
+// a build with -DMYHEAP_PROFILE charges every allocation to the "file:line" it was made from
+// freeing needs no site, so myFree and heapFree stay as they are
+#if defined(MYHEAP_PROFILE) && !defined(MYHEAP_SOURCE)
+#define MYHEAP_STRING(x) #x
+#define MYHEAP_LINE(x)   MYHEAP_STRING(x)
+#define MYHEAP_SITE      __FILE__ ":" MYHEAP_LINE(__LINE__)
+#define myMalloc(size)                 myMallocAt(size, MYHEAP_SITE)
+#define myRealloc(block, size)         myReallocAt(block, size, MYHEAP_SITE)
+#define myCalloc(nelem, size)          myCallocAt(nelem, size, MYHEAP_SITE)
+#define heapMalloc(h, size)            heapMallocAt(h, size, MYHEAP_SITE)
+#define heapRealloc(h, block, size)    heapReallocAt(h, block, size, MYHEAP_SITE)
+#define heapCalloc(h, nelem, size)     heapCallocAt(h, nelem, size, MYHEAP_SITE)
+#endif
 
 #endif
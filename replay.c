@@ -0,0 +1,221 @@
+// COMP1521 18s1 Assignment 2
+// myHeap benchmark: replay a recorded allocation trace against myHeap
+// record one with  MYHEAP_TRACE=file ./program ...  then run  ./replay file [Repeats [Policy]]
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "myHeap.h"
+#include "Trace.h"
+
+typedef struct {
+   int op;       // TRACE_ code
+   size_t size;
+   int id;       // block the call works on, numbered in order of allocation
+   int from;     // block a realloc resizes or -1, or the alignment of a memalign
+} Event;
+
+static char *policies[] = { "best", "first", "next" };   // by HEAP_ code
+
+static Heap heap;
+static Event *events;
+static int nEvents;
+static int nBlocks;
+static void **blocks;
+
+// live blocks by heap offset, for turning offsets in the trace into block ids
+static uint64_t *hashKey;
+static int *hashId;
+static int hashSize;
+
+static int *slotOf(uint64_t offset, int insert)
+{
+   int i = (offset * 0x9E3779B97F4A7C15u >> 32) & (hashSize - 1);
+   while (hashKey[i] != TRACE_NONE && hashKey[i] != offset) i = (i + 1) & (hashSize - 1);
+   if (hashKey[i] == TRACE_NONE && !insert) return NULL;
+   hashKey[i] = offset;
+   return &hashId[i];
+}
+
+// remove offset from the table, shuffling back any entries that probed past it
+static int takeId(uint64_t offset)
+{
+   int *slot = slotOf(offset, 0);
+   if (slot == NULL) return -1;
+   int id = *slot;
+   int i = slot - hashId;
+   hashKey[i] = TRACE_NONE;
+   for (int j = (i + 1) & (hashSize - 1); hashKey[j] != TRACE_NONE; j = (j + 1) & (hashSize - 1)) {
+      uint64_t k = hashKey[j];
+      int v = hashId[j];
+      hashKey[j] = TRACE_NONE;
+      *slotOf(k, 1) = v;
+   }
+   return id;
+}
+
+// apply one TRACE_CONFIG record, settings this replay does not know are left at their defaults
+static void setOption(HeapConfig *config, uint64_t which, uint64_t value)
+{
+   switch (which) {
+   case TRACE_SET_MAX_SIZE:   config->maxSize = value; break;
+   case TRACE_SET_GROW_BY:    config->growBy = value; break;
+   case TRACE_SET_POLICY:     config->policy = value; break;
+   case TRACE_SET_HIGH_ABOVE: config->highAbove = value; break;
+   case TRACE_SET_COMPACT:    config->compact = value; break;
+   case TRACE_SET_MAPPED:     config->mapped = value; break;
+   case TRACE_SET_CONCURRENT: config->concurrent = value; break;
+   }
+}
+
+// read a trace and number its blocks, returns the heap config it was recorded with
+static HeapConfig loadTrace(char *name)
+{
+   FILE *in = fopen(name, "rb");
+   TraceRecord rec;
+   if (in == NULL || fread(&rec, sizeof(rec), 1, in) != 1 || rec.op != TRACE_INIT) {
+      printf("%s is not a myHeap trace\n", name);
+      exit(1);
+   }
+   HeapConfig config = { .size = rec.size, .align = rec.old };
+   if (rec.offset != TRACE_NONE) config.mapAbove = rec.offset;
+   fseek(in, 0, SEEK_END);
+   long n = ftell(in) / sizeof(TraceRecord) - 1;
+   fseek(in, sizeof(TraceRecord), SEEK_SET);
+   events = malloc(n * sizeof(Event));
+   for (hashSize = 1024; hashSize < 2*n; hashSize *= 2) ;
+   hashKey = malloc(hashSize * sizeof(uint64_t));
+   hashId = malloc(hashSize * sizeof(int));
+   memset(hashKey, 0xFF, hashSize * sizeof(uint64_t));
+
+   while (fread(&rec, sizeof(rec), 1, in) == 1) {
+      Event e = { .op = rec.op, .size = rec.size, .id = -1, .from = -1 };
+      switch (rec.op) {
+      case TRACE_FREE:
+         e.id = takeId(rec.offset);
+         break;
+      case TRACE_REALLOC:
+         if (rec.old != TRACE_NONE) e.from = takeId(rec.old);
+         if (rec.offset == TRACE_NONE && rec.size > 0 && e.from >= 0)
+            *slotOf(rec.old, 1) = e.from;                         // failed, so the old block lives on
+         // fall through, the result is a new block
+      case TRACE_MALLOC:
+      case TRACE_CALLOC:
+      case TRACE_MEMALIGN:
+         if (rec.op == TRACE_MEMALIGN) e.from = rec.old;
+         if (rec.offset != TRACE_NONE) {
+            e.id = nBlocks++;
+            *slotOf(rec.offset, 1) = e.id;
+         }
+         break;
+      case TRACE_CONFIG:
+         setOption(&config, rec.old, rec.size);
+         continue;
+      default:
+         continue;
+      }
+      events[nEvents++] = e;
+   }
+   fclose(in);
+   blocks = calloc(nBlocks + 1, sizeof(void *));
+   return config;
+}
+
+static long nanos(void)
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+// make one call, a block the recording never got is not asked for again
+static void play(Event *e)
+{
+   void *p = NULL;
+   switch (e->op) {
+   case TRACE_MALLOC:   p = heapMalloc(heap, e->size); break;
+   case TRACE_CALLOC:   p = heapCalloc(heap, 1, e->size); break;
+   case TRACE_MEMALIGN: p = heapMemalign(heap, e->from, e->size); break;
+   case TRACE_REALLOC:  p = heapRealloc(heap, (e->from < 0) ? NULL : blocks[e->from], e->size); break;
+   case TRACE_FREE:
+      if (e->id >= 0 && blocks[e->id] != NULL) heapFree(heap, blocks[e->id]);
+      return;
+   }
+   if (e->op == TRACE_REALLOC && e->from >= 0 && (p != NULL || e->size < 1)) blocks[e->from] = NULL;
+   if (e->id >= 0) blocks[e->id] = p;
+}
+
+// start a run on a fresh heap, dropping whatever the last run left allocated
+static void reset(HeapConfig *config)
+{
+   memset(blocks, 0, (nBlocks + 1) * sizeof(void *));
+   heapDestroy(heap);
+   heap = heapCreateWith(config);
+   if (heap == NULL) {
+      printf("Can't create heap\n");
+      exit(1);
+   }
+}
+
+static int byValue(const void *a, const void *b)
+{
+   int x = *(int *)a, y = *(int *)b;
+   return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2) {
+      printf("Usage: %s TraceFile [Repeats [best|first|next]]\n", argv[0]);
+      exit(1);
+   }
+   int repeats = (argc > 2) ? atoi(argv[2]) : 10;
+   HeapConfig config = loadTrace(argv[1]);
+   if (argc > 3) {
+      while (config.policy <= HEAP_NEXT_FIT && strcmp(argv[3], policies[config.policy]) != 0) config.policy++;
+      if (config.policy > HEAP_NEXT_FIT) {
+         printf("Unknown policy %s\n", argv[3]);
+         exit(1);
+      }
+   }
+   if (nEvents == 0 || repeats < 1) {
+      printf("Nothing to replay\n");
+      exit(1);
+   }
+
+   // throughput, timing whole runs
+   long total = 0;
+   for (int r = 0; r < repeats; r++) {
+      reset(&config);
+      long t0 = nanos();
+      for (int i = 0; i < nEvents; i++) play(&events[i]);
+      total += nanos() - t0;
+   }
+
+   // latency and footprint, timing every call
+   int *lat = malloc(nEvents * sizeof(int));
+   long peakAlloc = 0;
+   int failed = 0;
+   reset(&config);
+   for (int i = 0; i < nEvents; i++) {
+      long t0 = nanos();
+      play(&events[i]);
+      lat[i] = nanos() - t0;
+      if (events[i].id >= 0 && events[i].op != TRACE_FREE && blocks[events[i].id] == NULL) failed++;
+      HeapStats s;
+      heapStats(heap, &s);
+      if (s.allocBytes > peakAlloc) peakAlloc = s.allocBytes;
+   }
+   qsort(lat, nEvents, sizeof(int), byValue);
+   heapDestroy(heap);
+
+   printf("%d calls x %d runs, heap %zu bytes, %s-fit\n", nEvents, repeats, config.size, policies[config.policy]);
+   printf("%.1f ns/op\n", (double) total / ((long) nEvents * repeats));
+   printf("latency ns: p50 %d  p90 %d  p99 %d  p99.9 %d  max %d\n",
+          lat[nEvents/2], lat[nEvents*9/10], lat[(int) (nEvents*0.99)],
+          lat[(int) (nEvents*0.999)], lat[nEvents-1]);
+   printf("peak footprint %ld bytes, %d allocations failed\n", peakAlloc, failed);
+   return 0;
+}
@@ -0,0 +1,101 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: file-backed heap reopened from its root
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "myHeap.h"
+
+#define HEAP_FILE "test10.heap"
+
+// list cells link by heap offset, so they survive the heap moving to another address
+typedef struct {
+   int value;
+   int next;      // heap offset of next cell, or -1
+} Cell;
+
+typedef struct {
+   int first;     // heap offset of first cell, or -1
+} List;
+
+static Cell *cellAt(Heap h, int offset)
+{
+   char *mem = (char *)heapRoot(h) - heapOffsetIn(h, heapRoot(h));
+   return (offset < 0) ? NULL : (Cell *)(mem + offset);
+}
+
+static void showList(Heap h)
+{
+   List *list = heapRoot(h);
+   for (Cell *c = cellAt(h, list->first); c != NULL; c = cellAt(h, c->next))
+      printf("%d ", c->value);
+   printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+   unlink(HEAP_FILE);
+   HeapConfig config = { .size = 4096, .path = HEAP_FILE };
+   Heap h = heapCreateWith(&config);
+   if (h == NULL) {
+      printf("Can't create heap file\n");
+      exit(1);
+   }
+   List *list = heapMalloc(h, sizeof(List));
+   list->first = -1;
+   heapSetRoot(h, list);
+   void *gaps[5];
+   for (int i = 5; i >= 1; i--) {
+      Cell *c = heapMalloc(h, sizeof(Cell));
+      gaps[i-1] = heapMalloc(h, 20*i);
+      c->value = i*10;
+      c->next = list->first;
+      list->first = heapOffsetIn(h, c);
+   }
+   for (int i = 0; i < 5; i += 2) heapFree(h, gaps[i]);   // leave some holes in the free list
+   heapDump(h);
+   heapDestroy(h);
+
+   // reopening ignores the size asked for and picks up the chunks and free list
+   config.size = 100000;
+   h = heapCreateWith(&config);
+   printf("reopened: ");
+   showList(h);
+   heapDump(h);
+   Cell *c = heapMalloc(h, sizeof(Cell));   // best fit is the smaller hole
+   printf("new cell at +%05ld\n", heapOffsetIn(h, c));
+
+   // the file is locked while it is open, so a second handle is refused
+   printf("second open: %s\n", (heapCreateWith(&config) == NULL) ? "refused" : "allowed");
+   heapDestroy(h);
+
+   // a user that dies without closing the file leaves it unsaved, so the next one rebuilds the free list
+   fflush(stdout);
+   pid_t pid = fork();
+   if (pid == 0) {
+      h = heapCreateWith(&config);
+      heapMalloc(h, 40);
+      _exit(0);
+   }
+   waitpid(pid, NULL, 0);
+   Heap again = heapCreateWith(&config);
+   printf("unsaved: ");
+   showList(again);
+   heapDump(again);
+   heapDestroy(again);
+
+   // a heap file cannot grow, so a ceiling big enough for wide headers does not change the ones it is made with
+   unlink(HEAP_FILE);
+   HeapConfig big = { .size = 4096, .maxSize = 8L << 30, .path = HEAP_FILE };
+   h = heapCreateWith(&big);
+   heapSetRoot(h, heapMalloc(h, 100));
+   heapDestroy(h);
+   h = heapCreateWith(&big);
+   printf("reopened with a ceiling: root at +%05ld\n", heapOffsetIn(h, heapRoot(h)));
+   heapDump(h);
+   heapDestroy(h);
+   unlink(HEAP_FILE);
+   return 0;
+}
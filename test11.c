@@ -0,0 +1,35 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: heapStats counters
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+static void showStats(Heap h)
+{
+   HeapStats s;
+   heapStats(h, &s);
+   printf("size %ld, alloc %ld in %ld, free %ld in %ld, largest %ld, frag %.3f\n",
+          s.size, s.allocBytes, s.allocChunks, s.freeBytes, s.freeChunks,
+          s.largestFree, s.fragmentation);
+   printf("mallocs %ld, frees %ld, splits %ld, merges %ld, free sizes:",
+          s.mallocs, s.frees, s.splits, s.merges);
+   for (int i = 0; i < 64; i++)
+      if (s.freeBySize[i] > 0) printf(" 2^%d:%d", i, s.freeBySize[i]);
+   printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+   Heap h = heapCreate(10000);
+   showStats(h);
+   void *p[10];
+   for (int i = 0; i < 10; i++) p[i] = heapMalloc(h, 100*(i+1));
+   showStats(h);
+   for (int i = 0; i < 10; i += 2) heapFree(h, p[i]);   // five holes
+   showStats(h);
+   for (int i = 1; i < 10; i += 2) heapFree(h, p[i]);   // holes merge back into one chunk
+   showStats(h);
+   heapDestroy(h);
+   return 0;
+}
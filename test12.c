@@ -0,0 +1,38 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: recording a trace of every call
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "myHeap.h"
+#include "Trace.h"
+
+#define TRACE_FILE "test12.trace"
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 4096, .mapped = 1, .trace = TRACE_FILE };   // mapped, so memalign offsets are repeatable
+   Heap h = heapCreateWith(&config);
+   void *a = heapMalloc(h, 100);
+   void *b = heapCalloc(h, 10, 20);
+   a = heapRealloc(h, a, 300);        // moves, but is recorded as one call
+   void *c = heapMemalign(h, 64, 50);
+   heapMalloc(h, 10000);              // fails
+   heapFree(h, b);
+   heapFree(h, a);
+   heapFree(h, c);
+   heapDestroy(h);
+
+   char *names[] = { "init", "malloc", "free", "realloc", "calloc", "memalign", "config" };
+   FILE *in = fopen(TRACE_FILE, "rb");
+   TraceRecord rec;
+   while (fread(&rec, sizeof(rec), 1, in) == 1) {
+      printf("%-8s size %5lu", names[rec.op], (unsigned long) rec.size);
+      if (rec.offset == TRACE_NONE) printf("  offset  none");
+      else printf("  offset %5lu", (unsigned long) rec.offset);
+      printf("  old %lu\n", (unsigned long) rec.old);
+   }
+   fclose(in);
+   unlink(TRACE_FILE);
+   return 0;
+}
@@ -0,0 +1,40 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: batch allocation and free
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   initHeap(4096);
+   void *hole = myMalloc(200);
+   void *keep = myMalloc(20);
+   myFree(hole);
+
+   // ten 100-byte chunks do not fit in the hole, so all come from the top chunk
+   void *p[40];
+   int got = myMallocBatch(100, 10, p);
+   printf("got %d, first at +%05ld\n", got, heapOffset(p[0]));
+   dumpHeap();
+
+   // free every other one, then the rest in one batch, out of order
+   void *odd[5], *even[5];
+   for (int i = 0; i < 5; i++) {
+      even[i] = p[8 - 2*i];
+      odd[i] = p[2*i + 1];
+   }
+   myFreeBatch(even, 5);
+   dumpHeap();
+   myFreeBatch(odd, 5);
+   dumpHeap();
+
+   // asking for more than fits fills the largest chunks and reports how many
+   got = myMallocBatch(100, 40, p);
+   printf("got %d of 40\n", got);
+   myFreeBatch(p, got);
+   myFree(keep);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
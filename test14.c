@@ -0,0 +1,60 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: arenas, and Trees built in one
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+#include "Arena.h"
+#include "Tree.h"
+
+int main(int argc, char *argv[])
+{
+   initHeap(8192);
+   Arena a = newArena(256);
+
+   // objects sit back to back with no headers, a big one gets a block of its own
+   char *x = arenaAlloc(a, 10);
+   char *y = arenaAlloc(a, 20);
+   char *z = arenaAlloc(a, 1000);
+   char *w = arenaAlloc(a, 8);
+   printf("y - x = %d, z at +%05ld, w - y = %d\n", (int) (y - x), heapOffset(z), (int) (w - y));
+   dumpHeap();
+
+   // after a reset the same blocks are handed out again, the big one first
+   arenaReset(a);
+   printf("after reset: starts at z %d\n", arenaAlloc(a, 10) == (void *) z);
+
+   // a Tree built in the arena is dropped with one reset
+   arenaReset(a);
+   treeUseArena(a);
+   Tree t = newTree();
+   for (int i = 1; i <= 20; i++) t = insert(t, (i * 7) % 20);
+   t = delete(t, 7);
+   printf("#nodes = %d, depth = %d\n", nnodes(t), depth(t));
+   dropTree(t);
+   t = insert(newTree(), 42);
+   printf("first node after drop reuses the arena: %d\n", (void *) t == (void *) z);
+
+   // nodes go back where they came from, whatever is in use when they are freed
+   for (int i = 1; i <= 5; i++) t = insert(t, i);
+   treeUseArena(NULL);
+   Tree p = insert(newTree(), 7);
+   t = insert(t, 6);                        // a pool node in the arena tree
+   t = delete(t, 3);                        // an arena node, left for the arena
+   t = delete(t, 6);                        // back to the pool
+   dropTree(p);
+   treeUseArena(a);
+   p = insert(insert(newTree(), 8), 9);     // built in the arena
+   treeUseArena(NULL);
+   Tree q = insert(newTree(), 10);
+   treeUseArena(a);
+   dropTree(q);                             // from the pool, so the arena is not reset
+   printf("arena kept: %d %d, #nodes = %d\n", find(t, 42), find(p, 9), nnodes(t));
+   dropTree(t);
+   treeUseArena(NULL);
+
+   dropArena(a);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,48 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: 64-bit sizes, and the wide headers of heaps that can pass 4GiB
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+static void showStats(Heap h)
+{
+   HeapStats s;
+   heapStats(h, &s);
+   printf("size %ld, alloc %ld in %ld, free %ld in %ld, largest %ld\n",
+          s.size, s.allocBytes, s.allocChunks, s.freeBytes, s.freeChunks, s.largestFree);
+}
+
+int main(int argc, char *argv[])
+{
+   // a small heap keeps narrow 8-byte headers
+   Heap small = heapCreate(4096);
+   char *a = heapMalloc(small, 20);
+   char *b = heapMalloc(small, 20);
+   printf("narrow: 20 bytes take %d\n", (int) (b - a));
+
+   // requests too big for an int used to wrap around
+   printf("8GiB request: %s\n", (heapMalloc(small, (size_t) 8 << 30) == NULL) ? "refused" : "allocated");
+   printf("request of -1: %s\n", (heapMalloc(small, -1) == NULL) ? "refused" : "allocated");
+   printf("calloc overflow: %s\n", (heapCalloc(small, (size_t) 1 << 40, (size_t) 1 << 30) == NULL) ? "refused" : "allocated");
+   heapDestroy(small);
+
+   // a heap that may grow to 16GiB has 16-byte headers and 64-bit sizes
+   HeapConfig config = { .size = 1 << 20, .maxSize = (size_t) 16 << 30 };
+   Heap big = heapCreateWith(&config);
+   if (big == NULL) {
+      printf("Can't reserve a 16GiB heap\n");
+      exit(1);
+   }
+   a = heapMalloc(big, 20);
+   b = heapMalloc(big, 20);
+   printf("wide: 20 bytes take %d\n", (int) (b - a));
+   char *c = heapMalloc(big, (size_t) 5 << 30);
+   c[((size_t) 5 << 30) - 1] = 1;
+   printf("5GiB chunk at +%05ld\n", heapOffsetIn(big, c));
+   showStats(big);
+   heapFree(big, c);
+   showStats(big);
+   heapDestroy(big);
+   return 0;
+}
@@ -0,0 +1,44 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: small chunks reused from quick lists, coalesced only when a request needs it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+static void showStats(Heap h)
+{
+   HeapStats s;
+   heapStats(h, &s);
+   printf("free %ld in %ld, largest %ld, merges %ld\n",
+          s.freeBytes, s.freeChunks, s.largestFree, s.merges);
+}
+
+int main(int argc, char *argv[])
+{
+   Heap h = heapCreate(4096);
+   void *a = heapMalloc(h, 20);
+   void *b = heapMalloc(h, 20);
+   void *c = heapMalloc(h, 20);
+   void *d = heapMalloc(h, 4004);            // the rest of the heap
+   showStats(h);
+
+   heapFree(h, b);                           // parked, not merged
+   showStats(h);
+   void *e = heapMalloc(h, 20);              // the same chunk straight back
+   printf("reused %s at +%05ld\n", (e == b) ? "yes" : "no", heapOffsetIn(h, e));
+
+   heapFree(h, a);
+   heapFree(h, e);
+   heapFree(h, c);
+   showStats(h);                             // three small free chunks, none merged yet
+
+   void *f = heapMalloc(h, 70);              // only fits once they are merged
+   printf("70 bytes at +%05ld\n", (f == NULL) ? -1 : heapOffsetIn(h, f));
+   showStats(h);
+
+   heapFree(h, f);
+   heapFree(h, d);
+   heapDump(h);
+   heapDestroy(h);
+   return 0;
+}
@@ -0,0 +1,49 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: placement policies choose different holes for the same request
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+static char *names[] = { "best-fit", "first-fit", "next-fit" };
+
+int main(int argc, char *argv[])
+{
+   for (int policy = HEAP_BEST_FIT; policy <= HEAP_NEXT_FIT; policy++) {
+      HeapConfig config = { .size = 4096, .policy = policy };
+      Heap h = heapCreateWith(&config);
+      void *a = heapMalloc(h, 100);
+      void *big = heapMalloc(h, 200);
+      void *b = heapMalloc(h, 100);
+      void *small = heapMalloc(h, 60);
+      void *c = heapMalloc(h, 100);
+      heapFree(h, big);                      // two holes, the big one lower down
+      heapFree(h, small);
+      void *p = heapMalloc(h, 40);
+      void *q = heapMalloc(h, 40);
+      printf("%-9s 40 bytes at +%05ld, then +%05ld\n", names[policy],
+             heapOffsetIn(h, p), heapOffsetIn(h, q));
+      heapFree(h, a);
+      heapFree(h, b);
+      heapFree(h, c);
+      heapFree(h, p);
+      heapFree(h, q);
+      heapDestroy(h);
+   }
+
+   HeapConfig config = { .size = 4096, .highAbove = 1000 };
+   Heap h = heapCreateWith(&config);
+   void *small = heapMalloc(h, 20);
+   void *big = heapMalloc(h, 2000);          // from the top, leaving the middle to small requests
+   void *next = heapMalloc(h, 20);
+   printf("high placement: 20 at +%05ld, 2000 at +%05ld, 20 at +%05ld\n",
+          heapOffsetIn(h, small), heapOffsetIn(h, big), heapOffsetIn(h, next));
+   heapDump(h);
+   heapFree(h, big);
+   heapDump(h);
+   heapDestroy(h);
+
+   config = (HeapConfig) { .size = 4096, .policy = 3 };
+   printf("unknown policy %s\n", (heapCreateWith(&config) == NULL) ? "refused" : "accepted");
+   return 0;
+}
@@ -0,0 +1,40 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: compact heaps with one-word chunk headers
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   for (int compact = 0; compact <= 1; compact++) {
+      HeapConfig config = { .size = 4096, .compact = compact };
+      Heap h = heapCreateWith(&config);
+      void *p[4];
+      for (int i = 0; i < 4; i++) p[i] = heapMalloc(h, 24);   // a Tree node
+      printf("%s: 24 bytes at +%05ld, +%05ld, +%05ld, +%05ld\n",
+             compact ? "compact" : "normal ", heapOffsetIn(h, p[0]),
+             heapOffsetIn(h, p[1]), heapOffsetIn(h, p[2]), heapOffsetIn(h, p[3]));
+      heapFree(h, p[1]);
+      heapFree(h, p[2]);                     // merged, with a footer at the end
+      heapDump(h);
+      heapFree(h, p[0]);
+      heapFree(h, p[3]);
+      heapDump(h);
+      heapDestroy(h);
+   }
+
+   HeapConfig config = { .size = 4096, .compact = 1, .concurrent = 1 };
+   printf("compact and concurrent %s\n", (heapCreateWith(&config) == NULL) ? "refused" : "accepted");
+   config = (HeapConfig) { .size = 4096, .maxSize = (size_t) 1 << 30, .compact = 1 };
+   printf("compact growing to 1GiB %s\n", (heapCreateWith(&config) == NULL) ? "refused" : "accepted");
+
+   config = (HeapConfig) { .size = 4096, .compact = 1 };
+   Heap h = heapCreateWith(&config);
+   char *q = heapMalloc(h, 24);
+   heapMalloc(h, 100);
+   q[-3] ^= 0x01;                           // a stray write into the size in q's header
+   fflush(stdout);
+   heapDump(h);                             // caught by the header's parity
+   return 0;
+}
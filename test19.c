@@ -0,0 +1,40 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: relocatable objects reached through handles, compacted a little at a time
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 4096 };
+   Heap h = heapCreateWith(&config);
+   Handle obj[8];
+   void *pinned[2];
+   pinned[0] = heapMalloc(h, 100);                   // ordinary chunks, which never move
+   for (int i = 0; i < 8; i++) {
+      obj[i] = heapHandleAlloc(h, 300);
+      memset(heapDeref(h, obj[i]), 'a' + i, 300);
+      if (i == 5) pinned[1] = heapMalloc(h, 100);
+   }
+   for (int i = 0; i < 8; i += 2) heapHandleFree(h, obj[i]);
+   heapDump(h);
+   printf("1600 bytes %s\n", (heapMalloc(h, 1600) == NULL) ? "refused" : "allocated");
+
+   int steps = 1;
+   while (heapCompact(h, 400)) steps++;   // a few objects moved at each step
+   printf("compacted in %d steps\n", steps);
+   heapDump(h);
+   for (int i = 1; i < 8; i += 2) {
+      char *p = heapDeref(h, obj[i]);
+      int same = 1;
+      for (int j = 0; j < 300; j++) same = same && p[j] == 'a' + i;
+      printf("handle %d at +%05ld %s\n", obj[i], heapOffsetIn(h, p), same ? "intact" : "damaged");
+   }
+   printf("pinned at +%05ld, +%05ld\n", heapOffsetIn(h, pinned[0]), heapOffsetIn(h, pinned[1]));
+   printf("1600 bytes %s\n", (heapMalloc(h, 1600) == NULL) ? "refused" : "allocated");
+   printf("handle %d reused\n", heapHandleAlloc(h, 8));
+   heapDestroy(h);
+   return 0;
+}
@@ -18,7 +18,8 @@ void freeList(List);
 
 int main(int argc, char *argv[])
 {
-   initHeap(10000);
+   HeapConfig config = { .size = 10000, .align = sizeof(void *) };   // Nodes hold a pointer
+   initHeapWith(&config);
    List list = NULL;
    for (int i = 0; i < 20; i++) {
       list = insert(list, rand()%100);
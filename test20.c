@@ -0,0 +1,53 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: huge requests in mappings of their own, outside the heap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myHeap.h"
+
+static void showMapped(Heap h)
+{
+   HeapStats s;
+   heapStats(h, &s);
+   printf("heap alloc %ld in %ld, mapped %ld in %ld, mallocs %ld, frees %ld\n",
+          s.allocBytes, s.allocChunks, s.mappedBytes, s.mappedChunks, s.mallocs, s.frees);
+}
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 4096, .mapAbove = 8192 };
+   Heap h = heapCreateWith(&config);
+   char *a = heapMalloc(h, 100);
+   char *big = heapMalloc(h, 100000);              // far more than the heap holds
+   memset(big, 'x', 100000);
+   char *zeroed = heapCalloc(h, 5000, 4);
+   int nonzero = 0;
+   for (int i = 0; i < 20000; i++) nonzero += zeroed[i] != 0;
+   printf("a at +%05ld, big at %ld, calloc at %ld, nonzero %d\n",
+          heapOffsetIn(h, a), heapOffsetIn(h, big), heapOffsetIn(h, zeroed), nonzero);
+   heapDump(h);
+   showMapped(h);
+
+   big = heapRealloc(h, big, 200000);              // still over the threshold, so mapped again
+   zeroed = heapRealloc(h, zeroed, 1000);          // under it, so back in the heap
+   printf("big at %ld, %s; small again at +%05ld\n", heapOffsetIn(h, big),
+          (big[99999] == 'x') ? "kept" : "lost", heapOffsetIn(h, zeroed));
+   heapDump(h);
+
+   void *p[4];
+   printf("batch of 3 got %d\n", heapMallocBatch(h, 10000, 3, p));
+   p[3] = a;
+   heapFreeBatch(h, p, 4);                         // mapped and heap blocks together
+   heapFree(h, big);
+   heapFree(h, zeroed);
+   heapDump(h);
+   showMapped(h);
+   heapDestroy(h);
+
+   config.mapAbove = 0;
+   h = heapCreateWith(&config);
+   printf("without mappings, 100000 bytes %s\n", (heapMalloc(h, 100000) == NULL) ? "refused" : "allocated");
+   heapDestroy(h);
+   return 0;
+}
@@ -0,0 +1,44 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: zeroed allocations from memory the system has zeroed, with no memset at creation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myHeap.h"
+
+static int nonzero(char *p, int n)
+{
+   int count = 0;
+   for (int i = 0; i < n; i++) count += (p[i] != 0);
+   return count;
+}
+
+int main(int argc, char *argv[])
+{
+   Heap h = heapCreate(64 << 20);               // left for the system to zero as it is touched
+   char *p = heapCalloc(h, 1, 1 << 20);
+   printf("fresh 64MB heap: calloc nonzero = %d\n", nonzero(p, 1 << 20));
+   heapDestroy(h);
+
+   HeapConfig config = { .size = 1 << 20, .mapped = 1 };
+   h = heapCreateWith(&config);
+   char *a = heapMalloc(h, 100);
+   char *big = heapMalloc(h, 500000);
+   memset(big, 0xFF, 500000);
+   heapFree(h, big);                            // merges with the top chunk
+   heapTrim(h);                                 // whose pages are zero again
+   p = heapCalloc(h, 1, 400000);
+   printf("after trim: calloc at +%05ld nonzero = %d\n", heapOffsetIn(h, p), nonzero(p, 400000));
+   char *q = heapCalloc(h, 1, 200000);          // partly over the dirty page at the trimmed chunk's start
+   printf("above it: calloc at +%05ld nonzero = %d\n", heapOffsetIn(h, q), nonzero(q, 200000));
+   memset(q, 0xFF, 200000);
+   heapFree(h, q);
+   q = heapCalloc(h, 1, 100000);                // dirty again, so cleared
+   printf("reused: calloc at +%05ld nonzero = %d\n", heapOffsetIn(h, q), nonzero(q, 100000));
+   heapFree(h, a);
+   heapFree(h, p);
+   heapFree(h, q);
+   heapDump(h);
+   heapDestroy(h);
+   return 0;
+}
@@ -0,0 +1,42 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: sampled allocation profile by call site, built with -DMYHEAP_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+static void *smallNode(void) { return myMalloc(100); }
+static void *bigBuffer(void) { return myCalloc(30, 100); }
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 1 << 20, .sampleEvery = 1000 };
+   initHeapWith(&config);
+   void *small[100], *big[5];
+   for (int i = 0; i < 100; i++) small[i] = smallNode();   // about one in ten sampled, each for 1000 bytes
+   for (int i = 0; i < 5; i++) big[i] = bigBuffer();       // over the interval, so every one is sampled
+   void *grown = myRealloc(NULL, 50);
+   grown = myRealloc(grown, 5000);
+   for (int i = 0; i < 50; i++) myFree(small[i]);
+   myFree(big[0]);
+
+   printf("in use:\n");
+   dumpProfile(1);
+   printf("allocated:\n");
+   dumpProfile(0);
+
+   for (int i = 50; i < 100; i++) myFree(small[i]);
+   for (int i = 1; i < 5; i++) myFree(big[i]);
+   myFree(grown);
+   printf("in use after freeing everything:\n");
+   dumpProfile(1);
+   freeHeap();
+
+   config.sampleEvery = 0;                                  // off: nothing is recorded
+   initHeapWith(&config);
+   myFree(smallNode());
+   printf("not sampling:\n");
+   dumpProfile(0);
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,46 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: Trees built with -DCOMPACT_TREE, whose nodes link by heap offset
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+#include "Tree.h"
+
+int main(int argc, char *argv[])
+{
+   initHeap(8192);
+
+   // pool nodes sit 12 bytes apart, an int and two 32-bit links
+   Tree t1 = insert(newTree(), 1);
+   Tree t2 = insertAtRoot(t1, 2);
+   printf("node stride = %d\n", (int) ((char *) t2 - (char *) t1));
+   dropTree(t2);
+
+   // the usual operations walk offset links just as they walk pointers
+   Tree t = newTree();
+   for (int i = 1; i <= 30; i++) t = insert(t, (i * 11) % 31);
+   printf("#nodes = %d, depth = %d\n", nnodes(t), depth(t));
+   for (int i = 0; i < 30; i += 3) t = delete(t, i);
+   t = insertAtRoot(t, 40);
+   t = rotateL(rotateR(t));
+   printf("#nodes = %d, depth = %d, find 4 = %d, find 6 = %d, find 40 = %d\n",
+          nnodes(t), depth(t), find(t, 4), find(t, 6), find(t, 40));
+   t = partition(t, nnodes(t) / 2);
+   printf("after partition: depth = %d, root = %d\n", depth(t), *get_ith(t, nnodes(t) / 2));
+   showTree(t);
+
+   dropTree(t);
+   dumpHeap();
+
+   // a tree still standing when its heap is replaced goes with it, new ones come from the new heap
+   t = insert(newTree(), 1);
+   freeHeap();
+   initHeap(8192);
+   t = insert(insert(newTree(), 2), 3);
+   printf("#nodes = %d, find 3 = %d\n", nnodes(t), find(t, 3));
+   showTree(t);
+   dropTree(t);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,85 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: threads freeing each other's chunks in a concurrent heap
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define NTHREADS 4
+#define NCHUNKS  500    // chunks each thread holds at once
+#define NROUNDS  20
+
+static Heap heap;
+static pthread_barrier_t barrier;
+static char *chunks[NTHREADS][NCHUNKS];
+static int failed[NTHREADS];     // allocations that failed, by thread
+static int clobbered[NTHREADS];  // chunks found overwritten when freed, by thread
+
+// sizes run from 8 bytes up past the thread caches' classes, so frees go
+// through the caches, the pending stack and the bins
+static size_t sizeOf(int i)
+{
+   return 8 + (i*37)%600;
+}
+
+// each round a thread fills its own chunks with its number, then checks and
+// frees the chunks of the thread after it
+static void *worker(void *arg)
+{
+   int me = *(int *)arg;
+   int next = (me + 1)%NTHREADS;
+   for (int r = 0; r < NROUNDS; r++) {
+      for (int i = 0; i < NCHUNKS; i++) {
+         chunks[me][i] = heapMalloc(heap, sizeOf(i));
+         if (chunks[me][i] == NULL) failed[me]++;
+         else memset(chunks[me][i], 'A' + me, sizeOf(i));
+      }
+      pthread_barrier_wait(&barrier);
+      for (int i = 0; i < NCHUNKS; i++) {
+         char *p = chunks[next][i];
+         if (p == NULL) continue;
+         for (size_t j = 0; j < sizeOf(i); j++)
+            if (p[j] != 'A' + next) {
+               clobbered[me]++;
+               break;
+            }
+         heapFree(heap, p);
+      }
+      pthread_barrier_wait(&barrier);
+   }
+   return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 1 << 22, .concurrent = 1 };
+   heap = heapCreateWith(&config);
+   pthread_barrier_init(&barrier, NULL, NTHREADS);
+   pthread_t threads[NTHREADS];
+   int ids[NTHREADS];
+   for (int t = 0; t < NTHREADS; t++) {
+      ids[t] = t;
+      pthread_create(&threads[t], NULL, worker, &ids[t]);
+   }
+   for (int t = 0; t < NTHREADS; t++)
+      pthread_join(threads[t], NULL);   // each thread's cache is flushed as it exits
+   pthread_barrier_destroy(&barrier);
+
+   int nFailed = 0, nClobbered = 0;
+   for (int t = 0; t < NTHREADS; t++) {
+      nFailed += failed[t];
+      nClobbered += clobbered[t];
+   }
+   printf("%d failed, %d clobbered\n", nFailed, nClobbered);
+   heapDump(heap);                      // all in one free chunk again
+   HeapStats s;
+   heapStats(heap, &s);
+   printf("mallocs %ld, frees %ld\n", s.mallocs, s.frees);
+   printf("%ld allocated, %ld free in %ld chunk(s), largest %ld of %ld\n",
+          s.allocChunks, s.freeBytes, s.freeChunks, s.largestFree, s.size);
+   heapDestroy(heap);
+   return 0;
+}
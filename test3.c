@@ -60,7 +60,7 @@ void dumpVars(void **vars)
    int onRow = 0;
    for (int i = 0; i < 26; i++) {
       if (vars[i] == NULL) continue;
-      printf("[%c] +%05d ", 'a'+i, heapOffset(vars[i]));
+      printf("[%c] +%05ld ", 'a'+i, heapOffset(vars[i]));
       onRow++;
       if (onRow == 5) {
          printf("\n");
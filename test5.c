@@ -0,0 +1,44 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: two independent heaps alongside the default one
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   initHeap(4096);
+   Heap h1 = heapCreate(4096);
+   Heap h2 = heapCreate(5000);
+   if (h1 == NULL || h2 == NULL) {
+      printf("Can't create heaps\n");
+      exit(1);
+   }
+
+   // interleave allocations so each heap sees its own pattern
+   void *a = heapMalloc(h1, 100);
+   void *b = heapMalloc(h2, 200);
+   void *c = myMalloc(300);
+   void *d = heapMalloc(h1, 400);
+   void *e = heapMalloc(h2, 500);
+   printf("a=+%05ld b=+%05ld c=+%05ld d=+%05ld e=+%05ld\n",
+          heapOffsetIn(h1, a), heapOffsetIn(h2, b), heapOffset(c),
+          heapOffsetIn(h1, d), heapOffsetIn(h2, e));
+   printf("b in h1: %ld\n", heapOffsetIn(h1, b));
+   printf("h1:\n"); heapDump(h1);
+   printf("h2:\n"); heapDump(h2);
+   printf("default:\n"); dumpHeap();
+
+   heapFree(h1, a);
+   heapFree(h2, e);
+   myFree(c);
+   printf("After frees ...\n");
+   printf("h1:\n"); heapDump(h1);
+   printf("h2:\n"); heapDump(h2);
+   printf("default:\n"); dumpHeap();
+
+   heapDestroy(h1);
+   heapDestroy(h2);
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,53 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: myRealloc growing/shrinking in place and moving, myCalloc
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   initHeap(4096);
+   char *a = myMalloc(100);
+   char *b = myMalloc(100);
+   strcpy(a, "hello");
+   myFree(b);
+   printf("a = malloc 100, b = malloc 100, free b\n");
+   dumpHeap();
+
+   char *old = a;
+   a = myRealloc(a, 180);
+   printf("a = realloc 180 (%s) %s\n", a, (a == old) ? "in place" : "moved");
+   dumpHeap();
+
+   old = a;
+   a = myRealloc(a, 40);
+   printf("a = realloc 40 (%s) %s\n", a, (a == old) ? "in place" : "moved");
+   dumpHeap();
+
+   char *c = myMalloc(50);
+   old = a;
+   a = myRealloc(a, 300);
+   printf("c = malloc 50, a = realloc 300 (%s) %s\n", a, (a == old) ? "in place" : "moved");
+   dumpHeap();
+
+   int *z = myCalloc(50, sizeof(int));
+   int sum = 0;
+   for (int i = 0; i < 50; i++) sum += z[i];
+   printf("z = calloc 50 ints at +%05ld, sum %d\n", heapOffset(z), sum);
+   memset(z, 0xff, 50*sizeof(int));
+   myFree(z);
+   z = myCalloc(50, sizeof(int));
+   sum = 0;
+   for (int i = 0; i < 50; i++) sum += z[i];
+   printf("z = calloc 50 ints again at +%05ld, sum %d\n", heapOffset(z), sum);
+   dumpHeap();
+
+   myFree(a);
+   myFree(c);
+   myFree(z);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,48 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: heap-wide alignment and myMemalign
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "myHeap.h"
+
+#define aligned(p,n) ((uintptr_t)(p) % (n) == 0)
+
+int main(int argc, char *argv[])
+{
+   // every chunk in a 64-byte aligned heap starts on a cache line
+   HeapConfig config = { .size = 4096, .align = 64 };
+   if (initHeapWith(&config) < 0) {
+      printf("Can't init aligned heap\n");
+      exit(1);
+   }
+   void *a = myMalloc(1);
+   void *b = myMalloc(100);
+   void *c = myMalloc(56);
+   printf("a,b,c aligned to 64: %d %d %d\n", aligned(a,64), aligned(b,64), aligned(c,64));
+   dumpHeap();
+   myFree(b);
+   void *d = myMemalign(32, 10);
+   printf("d = memalign 32 at +%05ld\n", heapOffset(d));
+   dumpHeap();
+   myFree(a); myFree(c); myFree(d);
+   dumpHeap();
+
+   // bad alignments are refused
+   HeapConfig bad = { .size = 4096, .align = 24 };
+   printf("align 24 heap: %s\n", (heapCreateWith(&bad) == NULL) ? "refused" : "created");
+
+   // in an ordinary heap the lead-in before an aligned chunk is left free
+   initHeap(4096);
+   void *x = myMalloc(20);
+   void *y = myMemalign(256, 100);
+   void *z = myMemalign(1024, 300);
+   printf("y aligned to 256: %d, z aligned to 1024: %d\n", aligned(y,256), aligned(z,1024));
+   printf("bad alignment: %s\n", (myMemalign(48, 10) == NULL) ? "refused" : "allocated");
+   myFree(y);
+   myFree(z);
+   myFree(x);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,36 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: growable heap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   // starts at 4096 bytes, grows a page at a time up to 16384
+   HeapConfig config = { .size = 4096, .maxSize = 16384, .growBy = 4096 };
+   if (initHeapWith(&config) < 0) {
+      printf("Can't init growable heap\n");
+      exit(1);
+   }
+   void *a = myMalloc(3000);
+   void *b = myMalloc(3000);      // does not fit, heap grows and merges with the top chunk
+   printf("a at +%05ld, b at +%05ld\n", heapOffset(a), heapOffset(b));
+   dumpHeap();
+   void *c = myMalloc(5000);      // bigger than one step, heap grows by the request
+   printf("c at +%05ld\n", heapOffset(c));
+   dumpHeap();
+   void *d = myMalloc(8000);      // would pass the ceiling
+   printf("d: %s\n", (d == NULL) ? "refused" : "allocated");
+   myFree(b);
+   myFree(a);
+   myFree(c);
+   dumpHeap();
+
+   // doubling by default
+   initHeapWith(&(HeapConfig) { .size = 4096, .maxSize = 1 << 20 });
+   for (int i = 0; i < 5; i++) myMalloc(4000);
+   dumpHeap();
+   freeHeap();
+   return 0;
+}
@@ -0,0 +1,44 @@
+// COMP1521 18s1 Assignment 2
+// myHeap test: mapped heap that hands free pages back to the system
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myHeap.h"
+
+int main(int argc, char *argv[])
+{
+   HeapConfig config = { .size = 1 << 20, .mapped = 1 };
+   Heap h = heapCreateWith(&config);
+   if (h == NULL) {
+      printf("Can't create mapped heap\n");
+      exit(1);
+   }
+
+   // fill a large chunk, free it and trim, the neighbours must survive
+   char *a = heapMalloc(h, 100);
+   char *big = heapMalloc(h, 200000);
+   char *b = heapMalloc(h, 100);
+   strcpy(a, "below");
+   strcpy(b, "above");
+   memset(big, 0xFF, 200000);
+   heapFree(h, big);
+   heapTrim(h);
+   printf("a = %s, b = %s\n", a, b);
+   heapDump(h);
+
+   // the space comes back as it was freed and is usable again
+   char *c = heapMalloc(h, 150000);
+   memset(c, 'c', 150000);
+   int *z = heapCalloc(h, 1000, sizeof(int));
+   int nonzero = 0;
+   for (int i = 0; i < 1000; i++) nonzero += (z[i] != 0);
+   printf("c at +%05ld, calloc nonzero = %d\n", heapOffsetIn(h, c), nonzero);
+   heapFree(h, c);
+   heapFree(h, z);
+   heapFree(h, a);
+   heapFree(h, b);
+   heapDump(h);
+   heapDestroy(h);
+   return 0;
+}
@@ -0,0 +1,2 @@
+# creates two heaps next to the default heap and uses all three
+./test5
@@ -0,0 +1,2 @@
+# grows and shrinks a chunk in place, then forces a move; zeroed allocation
+./test6
@@ -0,0 +1,2 @@
+# 64-byte aligned heap, then aligned chunks carved from an ordinary heap
+./test7
@@ -0,0 +1,2 @@
+# growable heap: grows by a fixed step up to a ceiling, then by doubling
+./test8
@@ -0,0 +1,2 @@
+# mapped heap: trimming free pages leaves the rest of the heap intact
+./test9
@@ -0,0 +1,2 @@
+# file-backed heap: close, reopen from the root object, rebuild an unsaved file
+./test10
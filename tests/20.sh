@@ -0,0 +1,2 @@
+# heap statistics: sizes, counts, fragmentation and event counters
+./test11
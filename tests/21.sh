@@ -0,0 +1,2 @@
+# trace recording: one record per call, with the offsets it used
+./test12
@@ -0,0 +1,2 @@
+# batch malloc and free: carving from one chunk, coalescing runs
+./test13
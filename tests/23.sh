@@ -0,0 +1,2 @@
+# arenas: bump allocation, reset, and Trees built in an arena
+./test14
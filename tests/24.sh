@@ -0,0 +1,2 @@
+# 64-bit sizes: oversized requests refused, a wide heap holding a 5GiB chunk
+./test15
@@ -0,0 +1,2 @@
+# quick lists: a small chunk is reused as it is, neighbours merge only when a request needs it
+./test16
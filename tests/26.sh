@@ -0,0 +1,2 @@
+# placement policies: best, first and next fit pick different holes, big requests can come from the top
+./test17
@@ -0,0 +1,2 @@
+# compact heaps: 4-byte headers, refused when shared or too big, corrupt headers caught
+./test18 2>&1
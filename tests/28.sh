@@ -0,0 +1,2 @@
+# handles: objects slide down past free space, pinned chunks stay, a big request fits after
+./test19
@@ -0,0 +1,2 @@
+# huge requests: mapped outside the heap, reported apart, unmapped on free
+./test20
@@ -0,0 +1,2 @@
+# zeroing: heaps start without a memset, calloc skips memory known to be zero, trimmed top included
+./test21
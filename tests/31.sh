@@ -0,0 +1,2 @@
+# profiling: sampled allocations charged to their file:line, dumped as collapsed stacks
+./test22
@@ -0,0 +1,2 @@
+# compact Trees: 12-byte nodes linked by 32-bit heap offsets
+./test23
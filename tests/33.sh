@@ -0,0 +1,2 @@
+# threads freeing each other's chunks, everything back in one free chunk once they have gone
+./test24